@@ -0,0 +1,134 @@
+#include "BinningAnalysis.h"
+
+#include <cmath>
+
+// minimal number of blocks on the level to use it for error estimation
+#define BINNING_MIN_BLOCKS 32
+// squared errors of the neighbouring levels closer than this ratio are taken as the plateau,
+// it is 2 for the blocks much shorter than the autocorrelation time
+#define BINNING_PLATEAU_RATIO 1.5
+
+BinningAnalysis::BinningAnalysis():
+n(0),
+shift(0)
+{
+}
+
+void BinningAnalysis::add(double x)
+{
+    if (this->n == 0)
+        this->shift = x;
+    ++this->n;
+
+    double a = x - this->shift;
+    double b = a * a;
+    for (unsigned k = 0;; ++k){
+        if (k == this->levels.size())
+            this->levels.push_back(Level());
+        Level & l = this->levels[k];
+
+        l.sa += a;
+        l.sa2 += a * a;
+        l.sb += b;
+        l.sb2 += b * b;
+        l.sab += a * b;
+        ++l.blocks;
+
+        if (!l.hasPending){
+            l.pendingA = a;
+            l.pendingB = b;
+            l.hasPending = true;
+            break;
+        }
+
+        // the block of the next level is complete
+        a = (a + l.pendingA) / 2.;
+        b = (b + l.pendingB) / 2.;
+        l.hasPending = false;
+    }
+}
+
+void BinningAnalysis::clear()
+{
+    this->levels.clear();
+    this->n = 0;
+    this->shift = 0;
+}
+
+double BinningAnalysis::mean() const
+{
+    if (this->n == 0)
+        return 0;
+    return this->shift + this->levels[0].sa / this->levels[0].blocks;
+}
+
+double BinningAnalysis::meanError() const
+{
+    return sqrt(this->meanError2(this->reliableLevel()));
+}
+
+double BinningAnalysis::variance() const
+{
+    if (this->n == 0)
+        return 0;
+    const Level & l = this->levels[0];
+    const double a = l.sa / l.blocks;
+    return l.sb / l.blocks - a * a;
+}
+
+double BinningAnalysis::varianceError() const
+{
+    if (this->n < 2)
+        return 0;
+    const Level & l = this->levels[this->reliableLevel()];
+    if (l.blocks < 2)
+        return 0;
+
+    const double a = l.sa / l.blocks;
+    const double b = l.sb / l.blocks;
+    const double varA = l.sa2 / l.blocks - a * a;
+    const double varB = l.sb2 / l.blocks - b * b;
+    const double covAB = l.sab / l.blocks - a * b;
+
+    // linear error propagation for f = <b> - <a>^2
+    const double res = (4. * a * a * varA - 4. * a * covAB + varB) / (l.blocks - 1);
+    return (res > 0) ? sqrt(res) : 0;
+}
+
+double BinningAnalysis::tau() const
+{
+    const double e0 = this->meanError2(0);
+    if (e0 <= 0)
+        return 0;
+    return 0.5 * this->meanError2(this->reliableLevel()) / e0;
+}
+
+bool BinningAnalysis::converged() const
+{
+    const unsigned k = this->reliableLevel();
+    if (k == 0)
+        return true;
+    return this->meanError2(k) < BINNING_PLATEAU_RATIO * this->meanError2(k - 1);
+}
+
+unsigned BinningAnalysis::reliableLevel() const
+{
+    unsigned res = 0;
+    for (unsigned k = 0; k < this->levels.size(); ++k){
+        if (this->levels[k].blocks >= BINNING_MIN_BLOCKS)
+            res = k;
+    }
+    return res;
+}
+
+double BinningAnalysis::meanError2(unsigned level) const
+{
+    if (level >= this->levels.size())
+        return 0;
+    const Level & l = this->levels[level];
+    if (l.blocks < 2)
+        return 0;
+    const double a = l.sa / l.blocks;
+    const double res = (l.sa2 / l.blocks - a * a) / (l.blocks - 1);
+    return (res > 0) ? res : 0;
+}
@@ -0,0 +1,56 @@
+#ifndef BINNINGANALYSIS_H
+#define BINNINGANALYSIS_H
+
+#include <vector>
+
+/**
+ * @brief Streaming logarithmic binning (blocking) of the time series.
+ * Level k keeps the sums over the averages of blocks of 2^k values, so the memory is O(log n)
+ * and the amortized work per value is O(1). Values x and x^2 are binned together, which gives
+ * the error bars both for <x> and for the variance <x^2>-<x>^2 (heat capacity, susceptibility).
+ */
+class BinningAnalysis
+{
+public:
+    BinningAnalysis();
+
+    void add(double x);
+    void clear();
+
+    unsigned long count() const { return this->n; }
+    unsigned levelsCount() const { return this->levels.size(); }
+
+    double mean() const;
+    double meanError() const;
+    double variance() const;
+    double varianceError() const;
+
+    /**
+     * @brief integrated autocorrelation time in sweeps, 0.5 for uncorrelated data
+     */
+    double tau() const;
+
+    /**
+     * @brief false if the error still grows with the block size at the last reliable level,
+     * i.e. the series is too short to resolve its autocorrelation time
+     */
+    bool converged() const;
+
+private:
+    struct Level {
+        double pendingA = 0, pendingB = 0; // first half of the next block
+        bool hasPending = false;
+        double sa = 0, sa2 = 0, sb = 0, sb2 = 0, sab = 0; // sums over the complete blocks
+        unsigned long blocks = 0;
+    };
+
+    // the last level which has enough blocks to give trustable errors
+    unsigned reliableLevel() const;
+    double meanError2(unsigned level) const;
+
+    std::vector<Level> levels;
+    unsigned long n;
+    double shift; // first value, subtracted from all values to avoid FP cancellation
+};
+
+#endif //BINNINGANALYSIS_H
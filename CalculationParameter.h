@@ -4,6 +4,7 @@
 #include <string>
 #include <gmpxx.h>
 #include "PartArray.h"
+#include "BinningAnalysis.h"
 
 class CalculationParameter
 {
@@ -16,15 +17,28 @@ public:
     virtual bool check(unsigned) const = 0;
     virtual void printHeader(unsigned) const = 0;
     virtual bool init(PartArray * sys) {this->sys = sys; return true;};
+    // the state of the prototype became its new initial state (hardReset), rebuild the tables which are relative to it
+    virtual void rebuild() {};
 
     virtual void iterate(unsigned id) = 0; // запускается при каждом успешном перевороте спина
+    virtual bool affects(unsigned) const { return true; } // false if the flip of the spin does not change the value, then iterate() is not called
     virtual void incrementTotal() = 0; // запускается после каждого шага Метрополиса
+    virtual double value() const = 0; // current value of the parameter, the one which is averaged
+    virtual void update() = 0; // recalculate the current value from the system state, instead of iterate()
+    // difference of the tracked value from the full recalculation, relative to max(1,|full|), for validation
+    virtual double mismatch() const { return 0; }
+
+    // estimated work of iterate() per flip of a random spin and of update(), to choose what is cheaper between measurements
+    virtual double iterateCost() const = 0;
+    virtual double updateCost() const = 0;
     virtual mpf_class getTotal(unsigned) = 0;
     virtual mpf_class getTotal2(unsigned) = 0;
     virtual mpf_class getTotal4(unsigned) = 0;
     double getTotalDouble(unsigned steps) { return getTotal(steps).get_d(); };
     double getTotal2Double(unsigned steps) { return getTotal2(steps).get_d(); };
+    const BinningAnalysis & binning() const { return this->_binning; }
 
+    // copies share the read-only tables built by the prototype, they keep only the values of their chain
     virtual CalculationParameter * copy() = 0;
 
     /**
@@ -41,6 +55,7 @@ protected:
     bool _binder;
     PartArray * sys;
     const PartArray * prototype;
+    BinningAnalysis _binning; // blocking of the values added in incrementTotal, for error bars
 
     void prototypeInit(PartArray* prototype){
         this->init(prototype);
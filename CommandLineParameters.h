@@ -17,6 +17,21 @@ public:
     bool binder = 0;
     int saveStates;
     int saveShort;
+    double precision;
+    bool autoHeatup = 0;
+    bool domains = 0;
+    int measureEvery;
+    int population;
+    int multiSpin;
+    int replicas;
+    int wangLandau;
+    double energyHistogram;
+    double refine;
+    int loops;
+    double nfold;
+    std::string affinity;
+    int validateEvery;
+    double validateBudget;
 
 protected:
     void add_parameters(argumentum::ParameterConfig &params) override
@@ -59,6 +74,67 @@ protected:
                 txt file, relative to the initial configuration.\
                 Default value is 0 means do not save the data.\
                 File name is \"<input filename>_<temperature_number>.txt\"");
+        params.add_parameter(precision,"","--precision").nargs(1).absent(NAN).metavar("ERR")
+            .help("Stop the calculate phase of a temperature when the relative error \
+                of C(T) (or of parameter set in precisionParameter of ini-file) becomes less than ERR. \
+                --calculate is the maximal number of steps then. Default is 0 means fixed steps count.");
+        params.add_parameter(measureEvery,"","--measureEvery").nargs(1).absent(-1).metavar("N")
+            .help("Measure energy and parameters only every N-th MC step. \
+                Parameters are recalculated from the state at the measurement when it is cheaper \
+                than to follow every spin flip. Default is 1.");
+        params.add_parameter(population,"","--population").nargs(1).absent(-1).metavar("R")
+            .help("Run population annealing with R replicas instead of one Metropolis chain per temperature. \
+                Temperatures are passed from the highest to the lowest. Default is 0 means disabled.");
+        params.add_parameter(replicas,"","--replicas").nargs(1).absent(-1).metavar("K")
+            .help("Number of independent chains per temperature, each with its own random stream. \
+                The chains share one copy of the system and make MC steps in turn, \
+                in blocks of up to 4 chains, which are calculated by different threads and MPI ranks. \
+                Single chains are printed as comment lines, the pooled result has errors \
+                from the spread between chains. Default is 1.");
+        params.add_parameter(refine,"","--refine").nargs(1).absent(NAN).metavar("DT")
+            .help("After the temperature list is calculated, add temperatures in the middle of intervals \
+                around the peak of C(T) (or susceptibility of refineParameter of ini-file) and where it changes fast, \
+                and repeat until the intervals are not wider than DT. New temperatures start from the state \
+                of the lower neighbour. Default is 0 means fixed temperature list.");
+        params.add_parameter(energyHistogram,"","--energyHistogram").nargs(1).absent(NAN).metavar("WIDTH")
+            .help("Save histogram of energy with bins of WIDTH for each temperature, \
+                with sums of parameter values in every bin. Histograms of several temperatures \
+                are combined by the reweighting program. Default is 0 means disabled.");
+        params.add_parameter(wangLandau,"","--wangLandau").nargs(1).absent(-1).metavar("BINS")
+            .help("Calculate the density of states g(E) by Wang-Landau walk over BINS energy bins \
+                instead of Metropolis, and print averages for all temperatures from it. \
+                Energy range is set by wangLandauEmin and wangLandauEmax of ini-file. \
+                Default is 0 means disabled.");
+        params.add_parameter(multiSpin,"","--multispin").nargs(1).absent(-1).metavar("R")
+            .help("Run R replicas per temperature with multi-spin coding, 64 replicas per machine word. \
+                Works only for csv systems with +-J couplings, without field and parameters. \
+                Default is 0 means disabled.");
+        params.add_parameter(loops,"","--loops").nargs(1).absent(-1).metavar("N")
+            .help("Number of loop move attempts after each MC step. The loop is the closed path \
+                of spins connected by satisfied strong bonds, like head-to-tail chains in spin ice. \
+                Default is 0 means single spin flips only.");
+        params.add_parameter(nfold,"","--nfold").nargs(1).absent(NAN).metavar("RATE")
+            .help("Switch a temperature to the rejection-free n-fold way dynamics when the \
+                acceptance rate of an MC step falls below RATE. 1 means always after the first step. \
+                Default is 0 means Metropolis only.");
+        params.add_parameter(validateEvery,"","--validateEvery").nargs(1).absent(-1).metavar("STEPS")
+            .help("Recalculate the energy and all parameters from scratch on random MC steps, every STEPS \
+                on average, and report the step and the last flipped spin when they differ from the tracked values \
+                more than validateTolerance of ini-file. The energy is tracked with compensated sums, so it is not \
+                needed for the accuracy. Default is 0 means never.");
+        params.add_parameter(validateBudget,"","--validateBudget").nargs(1).absent(NAN).metavar("FRACTION")
+            .help("Maximal fraction of the running time spent on --validateEvery checks, \
+                the checks are skipped while it is exceeded. Default is 0.01.");
+        params.add_parameter(affinity,"","--affinity").nargs(1).absent("").metavar("MODE")
+            .help("Pin the threads to cpus: close fills the sockets one by one, spread alternates the sockets. \
+                Memory of every temperature stays on the NUMA node of its thread then. \
+                Default is none means the threads are placed by the system.");
+        params.add_parameter(domains,"","--domains")
+            .help("if set, split the system along x into subdomains, one per MPI rank, \
+                and calculate the temperatures one by one on all ranks. For the systems too large for one node.");
+        params.add_parameter(autoHeatup,"","--autoHeatup")
+            .help("if set, finish the heatup when the energy becomes stationary. \
+                --heatup is the maximal number of steps then.");
         params.add_parameter(binder,"","--binder")
             .help("if set, calculate fourth-order cumulants for \
                 all parameters (energy, magnetisation, etc.).");
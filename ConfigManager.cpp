@@ -1,18 +1,175 @@
 #include "ConfigManager.h"
 
 Vect ConfigManager::size;
-vector < vector < double > > ConfigManager::energyTable;
+SparseTable ConfigManager::energyTable;
 
 bool ConfigManager::check_config()
 {
 
     //check main parameters
     {
-        if (this->calculate<1){
+        if (this->calculate<1 && this->population==0 && this->wangLandau==0){
             cerr<<"error! --calculate should be greather than 0!"<<endl;
             return false;
         }
 
+        if (this->population>0){
+            for (auto t : this->temperatures){
+                if (t<=0){
+                    cerr<<"error! population annealing works only with positive temperatures!"<<endl;
+                    return false;
+                }
+            }
+            if (this->populationSweeps<1){
+                cerr<<"error! populationSweeps should be greather than 0!"<<endl;
+                return false;
+            }
+        }
+
+        if (this->multiSpin>0){
+            if (!this->isCSV()){
+                cerr<<"error! multispin works only with csv systems!"<<endl;
+                return false;
+            }
+            if (this->population>0){
+                cerr<<"error! multispin and population can not be used together!"<<endl;
+                return false;
+            }
+            if (this->field.x!=0 || this->field.y!=0 || this->field.z!=0){
+                cerr<<"error! multispin works only without external field!"<<endl;
+                return false;
+            }
+            if (this->parameters.size()>0){
+                cerr<<"error! multispin calculates energy only, remove the parameter sections!"<<endl;
+                return false;
+            }
+        }
+
+        if (this->wangLandau>0){
+            if (this->population>0 || this->multiSpin>0){
+                cerr<<"error! wangLandau can not be used together with population or multispin!"<<endl;
+                return false;
+            }
+            if (this->wangLandau<4){
+                cerr<<"error! wangLandau should be the number of energy bins, at least 4!"<<endl;
+                return false;
+            }
+            if (isnan(this->wangLandauEmin) || isnan(this->wangLandauEmax) || this->wangLandauEmin>=this->wangLandauEmax){
+                cerr<<"error! wangLandauEmin and wangLandauEmax should be set, and wangLandauEmin < wangLandauEmax!"<<endl;
+                return false;
+            }
+            if (this->wangLandauPrecision<=0){
+                cerr<<"error! wangLandauPrecision should be greather than 0!"<<endl;
+                return false;
+            }
+            if (this->wangLandauMaxSteps<1){
+                cerr<<"error! wangLandauMaxSteps should be greather than 0!"<<endl;
+                return false;
+            }
+            for (auto t : this->temperatures){
+                if (t<=0){
+                    cerr<<"error! wangLandau gives averages only for positive temperatures!"<<endl;
+                    return false;
+                }
+            }
+            if (this->parameters.size()>0){
+                cerr<<"error! wangLandau calculates energy only, remove the parameter sections!"<<endl;
+                return false;
+            }
+        }
+
+        if (this->validateTolerance<=0){
+            cerr<<"error! validateTolerance should be greather than 0!"<<endl;
+            return false;
+        }
+
+        if (this->validateBudget<=0 || this->validateBudget>1){
+            cerr<<"error! validateBudget should be in (0,1]!"<<endl;
+            return false;
+        }
+
+        if (this->affinity!="none" && this->affinity!="close" && this->affinity!="spread"){
+            cerr<<"error! affinity should be none, close or spread!"<<endl;
+            return false;
+        }
+
+        if (this->domains){
+            if (this->isCSV() || this->range<=0){
+                cerr<<"error! domains work only with mfsys systems and range > 0!"<<endl;
+                return false;
+            }
+            if (this->population>0 || this->multiSpin>0 || this->wangLandau>0){
+                cerr<<"error! domains can not be used together with population, multispin or wangLandau!"<<endl;
+                return false;
+            }
+            if (this->parameters.size()>0){
+                cerr<<"error! domains calculate energy and magnetisation only, remove the parameter sections!"<<endl;
+                return false;
+            }
+        }
+
+        if (this->loopThreshold<=0 || this->loopThreshold>1){
+            cerr<<"error! loopThreshold should be in range (0,1]!"<<endl;
+            return false;
+        }
+
+        if (this->nfold<0 || this->nfold>1){
+            cerr<<"error! nfold should be in range [0,1]!"<<endl;
+            return false;
+        }
+
+        if (this->refine<0){
+            cerr<<"error! refine should not be negative!"<<endl;
+            return false;
+        }
+
+        if (this->refineParameter!="C"){
+            bool found = false;
+            for (auto & co : parameters){
+                if (co->parameterId()==this->refineParameter) found = true;
+            }
+            if (!found){
+                cerr<<"error! refineParameter should be C or id of one of the parameters!"<<endl;
+                return false;
+            }
+        }
+
+        if (this->energyHistogram<0){
+            cerr<<"error! energyHistogram should not be negative!"<<endl;
+            return false;
+        }
+
+        if (this->replicas<1){
+            cerr<<"error! replicas should be greather than 0!"<<endl;
+            return false;
+        }
+
+        if (this->measureEvery<1){
+            cerr<<"error! --measureEvery should be greather than 0!"<<endl;
+            return false;
+        }
+
+        if (this->measureEvery>this->calculate && this->population==0 && this->wangLandau==0){
+            cerr<<"error! --measureEvery should not be greather than --calculate, nothing would be measured!"<<endl;
+            return false;
+        }
+
+        if (this->precision<0){
+            cerr<<"error! --precision should not be negative!"<<endl;
+            return false;
+        }
+
+        if (this->precisionParameter!="C"){
+            bool found = false;
+            for (auto & co : parameters){
+                if (co->parameterId()==this->precisionParameter) found = true;
+            }
+            if (!found){
+                cerr<<"error! precisionParameter should be C or id of one of the parameters!"<<endl;
+                return false;
+            }
+        }
+
     }
 
     //check parameters of the core
@@ -25,7 +182,8 @@ bool ConfigManager::check_config()
 
 ConfigManager ConfigManager::init(
     const CommandLineParameters & commandLineParameters, 
-    const inicpp::config & iniconfig)
+    const inicpp::config & iniconfig,
+    bool root)
 {
     ConfigManager tmp;
 
@@ -34,6 +192,35 @@ ConfigManager ConfigManager::init(
         if (sect.contains("file")) tmp.sysfile = sect["file"].get<inicpp::string_ini_t>();
         if (sect.contains("heatup")) tmp.heatup = sect["heatup"].get<inicpp::unsigned_ini_t>();
         if (sect.contains("calculate")) tmp.calculate = sect["calculate"].get<inicpp::unsigned_ini_t>();
+        if (sect.contains("loops")) tmp.loops = sect["loops"].get<inicpp::unsigned_ini_t>();
+        if (sect.contains("loopThreshold")) tmp.loopThreshold = sect["loopThreshold"].get<inicpp::float_ini_t>();
+        if (sect.contains("loopthreshold")) tmp.loopThreshold = sect["loopthreshold"].get<inicpp::float_ini_t>();
+        if (sect.contains("nfold")) tmp.nfold = sect["nfold"].get<inicpp::float_ini_t>();
+        if (sect.contains("multispin")) tmp.multiSpin = sect["multispin"].get<inicpp::unsigned_ini_t>();
+        if (sect.contains("multiSpin")) tmp.multiSpin = sect["multiSpin"].get<inicpp::unsigned_ini_t>();
+        if (sect.contains("replicas")) tmp.replicas = sect["replicas"].get<inicpp::unsigned_ini_t>();
+        if (sect.contains("refine")) tmp.refine = sect["refine"].get<inicpp::float_ini_t>();
+        if (sect.contains("refineParameter")) tmp.refineParameter = sect["refineParameter"].get<inicpp::string_ini_t>();
+        if (sect.contains("refineparameter")) tmp.refineParameter = sect["refineparameter"].get<inicpp::string_ini_t>();
+        if (sect.contains("energyHistogram")) tmp.energyHistogram = sect["energyHistogram"].get<inicpp::float_ini_t>();
+        if (sect.contains("energyhistogram")) tmp.energyHistogram = sect["energyhistogram"].get<inicpp::float_ini_t>();
+        if (sect.contains("wangLandau")) tmp.wangLandau = sect["wangLandau"].get<inicpp::unsigned_ini_t>();
+        if (sect.contains("wanglandau")) tmp.wangLandau = sect["wanglandau"].get<inicpp::unsigned_ini_t>();
+        if (sect.contains("wangLandauEmin")) tmp.wangLandauEmin = sect["wangLandauEmin"].get<inicpp::float_ini_t>();
+        if (sect.contains("wanglandauemin")) tmp.wangLandauEmin = sect["wanglandauemin"].get<inicpp::float_ini_t>();
+        if (sect.contains("wangLandauEmax")) tmp.wangLandauEmax = sect["wangLandauEmax"].get<inicpp::float_ini_t>();
+        if (sect.contains("wanglandauemax")) tmp.wangLandauEmax = sect["wanglandauemax"].get<inicpp::float_ini_t>();
+        if (sect.contains("wangLandauWindows")) tmp.wangLandauWindows = sect["wangLandauWindows"].get<inicpp::unsigned_ini_t>();
+        if (sect.contains("wanglandauwindows")) tmp.wangLandauWindows = sect["wanglandauwindows"].get<inicpp::unsigned_ini_t>();
+        if (sect.contains("wangLandauPrecision")) tmp.wangLandauPrecision = sect["wangLandauPrecision"].get<inicpp::float_ini_t>();
+        if (sect.contains("wanglandauprecision")) tmp.wangLandauPrecision = sect["wanglandauprecision"].get<inicpp::float_ini_t>();
+        if (sect.contains("wangLandauMaxSteps")) tmp.wangLandauMaxSteps = sect["wangLandauMaxSteps"].get<inicpp::unsigned_ini_t>();
+        if (sect.contains("wanglandaumaxsteps")) tmp.wangLandauMaxSteps = sect["wanglandaumaxsteps"].get<inicpp::unsigned_ini_t>();
+        if (sect.contains("population")) tmp.population = sect["population"].get<inicpp::unsigned_ini_t>();
+        if (sect.contains("populationSweeps")) tmp.populationSweeps = sect["populationSweeps"].get<inicpp::unsigned_ini_t>();
+        if (sect.contains("populationsweeps")) tmp.populationSweeps = sect["populationsweeps"].get<inicpp::unsigned_ini_t>();
+        if (sect.contains("measureEvery")) tmp.measureEvery = sect["measureEvery"].get<inicpp::unsigned_ini_t>();
+        if (sect.contains("measureevery")) tmp.measureEvery = sect["measureevery"].get<inicpp::unsigned_ini_t>();
         if (sect.contains("range")) tmp.range = sect["range"].get<inicpp::float_ini_t>();
         if (sect.contains("seed")) tmp.seed = sect["seed"].get<inicpp::unsigned_ini_t>();
         if (sect.contains("temperature")) tmp.temperatures = sect["temperature"].get_list<inicpp::float_ini_t>();
@@ -59,6 +246,26 @@ ConfigManager ConfigManager::init(
         if (sect.contains("saveGS")) tmp.newGSFilename = sect["saveGS"].get<inicpp::string_ini_t>();
         if (sect.contains("savegs")) tmp.newGSFilename = sect["savegs"].get<inicpp::string_ini_t>();
         if (sect.contains("binder") && sect["binder"].get<inicpp::boolean_ini_t>()) tmp._binder = 1;
+        if (sect.contains("validateEvery")) tmp.validateEvery = sect["validateEvery"].get<inicpp::unsigned_ini_t>();
+        if (sect.contains("validateevery")) tmp.validateEvery = sect["validateevery"].get<inicpp::unsigned_ini_t>();
+        if (sect.contains("validateTolerance")) tmp.validateTolerance = sect["validateTolerance"].get<inicpp::float_ini_t>();
+        if (sect.contains("validatetolerance")) tmp.validateTolerance = sect["validatetolerance"].get<inicpp::float_ini_t>();
+        if (sect.contains("validateBudget")) tmp.validateBudget = sect["validateBudget"].get<inicpp::float_ini_t>();
+        if (sect.contains("validatebudget")) tmp.validateBudget = sect["validatebudget"].get<inicpp::float_ini_t>();
+        // debug checks the energy and parameters after every step, regardless of the time
+        if (tmp.debug && tmp.validateEvery == 0){
+            tmp.validateEvery = 1;
+            tmp.validateBudget = 1;
+        }
+        if (sect.contains("affinity")) tmp.affinity = sect["affinity"].get<inicpp::string_ini_t>();
+        if (sect.contains("domains")) tmp.domains = sect["domains"].get<inicpp::boolean_ini_t>();
+        if (sect.contains("autoHeatup")) tmp.autoHeatup = sect["autoHeatup"].get<inicpp::boolean_ini_t>();
+        if (sect.contains("autoheatup")) tmp.autoHeatup = sect["autoheatup"].get<inicpp::boolean_ini_t>();
+        if (sect.contains("autoHeatupParameters")) tmp.autoHeatupParameters = sect["autoHeatupParameters"].get<inicpp::boolean_ini_t>();
+        if (sect.contains("autoheatupparameters")) tmp.autoHeatupParameters = sect["autoheatupparameters"].get<inicpp::boolean_ini_t>();
+        if (sect.contains("precision")) tmp.precision = sect["precision"].get<inicpp::float_ini_t>();
+        if (sect.contains("precisionParameter")) tmp.precisionParameter = sect["precisionParameter"].get<inicpp::string_ini_t>();
+        if (sect.contains("precisionparameter")) tmp.precisionParameter = sect["precisionparameter"].get<inicpp::string_ini_t>();
     }
     
     if (!commandLineParameters.sysfilename.empty())
@@ -67,6 +274,24 @@ ConfigManager ConfigManager::init(
         tmp.heatup = commandLineParameters.hSteps;
     if (commandLineParameters.cSteps != -1)
         tmp.calculate = commandLineParameters.cSteps;
+    if (commandLineParameters.loops != -1)
+        tmp.loops = commandLineParameters.loops;
+    if (!isnan(commandLineParameters.nfold))
+        tmp.nfold = commandLineParameters.nfold;
+    if (commandLineParameters.multiSpin != -1)
+        tmp.multiSpin = commandLineParameters.multiSpin;
+    if (commandLineParameters.replicas != -1)
+        tmp.replicas = commandLineParameters.replicas;
+    if (!isnan(commandLineParameters.refine))
+        tmp.refine = commandLineParameters.refine;
+    if (!isnan(commandLineParameters.energyHistogram))
+        tmp.energyHistogram = commandLineParameters.energyHistogram;
+    if (commandLineParameters.wangLandau != -1)
+        tmp.wangLandau = commandLineParameters.wangLandau;
+    if (commandLineParameters.population != -1)
+        tmp.population = commandLineParameters.population;
+    if (commandLineParameters.measureEvery != -1)
+        tmp.measureEvery = commandLineParameters.measureEvery;
     if (!isnan(commandLineParameters.iRange))
         tmp.range = commandLineParameters.iRange;
     if (commandLineParameters.rseed!=-1)
@@ -75,6 +300,18 @@ ConfigManager ConfigManager::init(
         tmp.temperatures = commandLineParameters.temperatures;
     if (commandLineParameters.binder)
         tmp._binder = 1;
+    if (commandLineParameters.autoHeatup)
+        tmp.autoHeatup = 1;
+    if (commandLineParameters.domains)
+        tmp.domains = 1;
+    if (commandLineParameters.validateEvery != -1)
+        tmp.validateEvery = commandLineParameters.validateEvery;
+    if (!isnan(commandLineParameters.validateBudget))
+        tmp.validateBudget = commandLineParameters.validateBudget;
+    if (!commandLineParameters.affinity.empty())
+        tmp.affinity = commandLineParameters.affinity;
+    if (!isnan(commandLineParameters.precision))
+        tmp.precision = commandLineParameters.precision;
 
     if (tmp.sysfile.compare(tmp.sysfile.length()-4,string::npos,".csv") == 0){ //if filename ends with .csv
         if (tmp.isPBC()) throw(std::invalid_argument("PBC option is not working when you load .csv - files"));
@@ -95,11 +332,17 @@ ConfigManager ConfigManager::init(
         ConfigManager::setCSVEnergies(tmp.system);
     } else if (tmp.sysfile.compare(tmp.sysfile.length()-6,string::npos,".mfsys") == 0) { //if filename ends with .mfsys
         tmp._csv = false;
-        tmp.system.load(tmp.sysfile);
-        tmp.system.state.hardReset();
-        tmp.system.setInteractionRange(tmp.range);
-        if (tmp.isPBC()){
-            ConfigManager::setPBCEnergies(tmp.system);
+        // every subdomain finds the neighbours and energies of its own spins, the full tables are not needed,
+        // and the spins of the subdomains are sent from the root rank
+        if (root || !tmp.domains){
+            tmp.system.load(tmp.sysfile);
+            tmp.system.state.hardReset();
+        }
+        if (!tmp.domains){
+            tmp.system.setInteractionRange(tmp.range);
+            if (tmp.isPBC()){
+                ConfigManager::setPBCEnergies(tmp.system);
+            }
         }
     } else {
         throw(std::invalid_argument("Workg input file extention. Only mfsys and csv files are supported!"));
@@ -110,6 +353,15 @@ ConfigManager ConfigManager::init(
     tmp.saveShort = commandLineParameters.saveShort;
     tmp.saveStateFileBasename = tmp.sysfile.substr(0, tmp.sysfile.find_last_of("."));
 
+    // magnetisation parameters with the same spins use the same moments
+    std::map< std::vector<uint64_t>, std::shared_ptr<const MagnetisationVector::Plan> > magnetisationPlans;
+    auto magnetisationPlan = [&](const std::vector<uint64_t> & spins){
+        auto & plan = magnetisationPlans[spins];
+        if (!plan)
+            plan = MagnetisationVector::buildPlan(tmp.system, spins);
+        return plan;
+    };
+
     for (auto & sect: iniconfig){
         const std::string parameterString = sect.get_name();
 
@@ -210,7 +462,7 @@ ConfigManager ConfigManager::init(
                     make_unique<MagnetisationCore>(t_parameterId,
                         &tmp.system,
                         ConfigManager::strToVect(a),
-                        spins);
+                        magnetisationPlan(spins));
 
                 if (setDebug) core->setDebug();
                 if (setModule) core->setModule(true);
@@ -228,7 +480,26 @@ ConfigManager ConfigManager::init(
             std::unique_ptr<MagnetisationLengthCore> core = 
                 make_unique<MagnetisationLengthCore>(parameterId,
                     &tmp.system,
-                    spins);
+                    magnetisationPlan(spins));
+
+            if (setDebug) core->setDebug();
+            core->setBinder(tmp.isBinder());
+
+            tmp.parameters.push_back(std::move(core));
+
+        } else if (parameterName == "structurefactor") {
+            if (!sect.contains("qmax"))
+                throw(std::invalid_argument("Parameter " + parameterString + " should have qmax field."));
+
+            unsigned qpoints = 21;
+            if (sect.contains("qpoints"))
+                qpoints = sect["qpoints"].get<inicpp::unsigned_ini_t>();
+
+            std::unique_ptr<StructureFactorCore> core = 
+                make_unique<StructureFactorCore>(parameterId,
+                    &tmp.system,
+                    sect["qmax"].get<inicpp::float_ini_t>(),
+                    qpoints);
 
             if (setDebug) core->setDebug();
             core->setBinder(tmp.isBinder());
@@ -240,6 +511,11 @@ ConfigManager ConfigManager::init(
         }
     }
 
+    // the magnetisation of the same spins is tracked once, by the first parameter
+    shareMagnetisationVectors(tmp.parameters);
+    for (auto & co : tmp.parameters)
+        co->init(&tmp.system);
+
     return tmp;
 }
 
@@ -254,15 +530,14 @@ void ConfigManager::printHeader()
         }
     }
 
-    double avgNeighb = 0;
-    for (int i=0; i<this->system.size(); ++i)
-        avgNeighb += this->system.neighbourSize(i);
-    avgNeighb /= this->system.size();
+    // the full system has no neighbours and energies when it is split to subdomains
+    double avgNeighb = 0, e = 0;
+    if (!this->domains){
+        for (int i=0; i<this->system.size(); ++i)
+            avgNeighb += this->system.neighbourSize(i);
+        avgNeighb /= this->system.size();
 
-    double e = system.E();
-    for (auto p : this->system.parts)
-    {
-        e -= p->m.scalar(field);
+        e = this->energy(this->system);
     }
 
     printf("# Metropolis algorithm for calculating heating capacity v%s\n",METROPOLIS_VERSION);
@@ -270,8 +545,14 @@ void ConfigManager::printHeader()
     printf("#   sysfile: %s\n",this->sysfile.c_str());
     printf("#    system: %d spins, ", this->system.size());
     if (!this->isCSV()) printf("%f interaction range, ", this->range);
-    printf("%f avg. neighbours\n", avgNeighb);
-    printf("#   physics: energy: %g, ext.filed: (%g,%g,%g), ",e,this->field.x,this->field.y,this->field.z);
+    if (this->domains)
+        printf("neighbours are found by subdomains\n");
+    else
+        printf("%f avg. neighbours\n", avgNeighb);
+    printf("#   physics: ");
+    if (!this->domains)
+        printf("energy: %g, ",e);
+    printf("ext.filed: (%g,%g,%g), ",this->field.x,this->field.y,this->field.z);
     if (this->isCSV())
         printf("hamiltonian: csv, ");
     else
@@ -285,15 +566,77 @@ void ConfigManager::printHeader()
             printf("open\n");
         }
     }
-    printf("#        MC: %u heatup, %u compute steps\n",this->heatup,this->calculate);
-    if (this->isRestart())
-        printf("#   restart: enabled, delta E threshold: %g*energy=%g\n",
-            this->getRestartThreshold(),
-            fabs(this->getRestartThreshold()*e));
+    if (this->population>0){
+        printf("# annealing: population of %u replicas, %u sweeps per temperature, from high to low temperature\n",
+            this->population, this->populationSweeps);
+    } else if (this->wangLandau>0){
+        printf("# W.-Landau: %u bins in [%g,%g], ",this->wangLandau,this->wangLandauEmin,this->wangLandauEmax);
+        if (this->wangLandauWindows>0)
+            printf("%u windows",this->wangLandauWindows);
+        else
+            printf("window per thread");
+        printf(" overlapping by %g, ln(f) down to %g or max. %u steps, max. %u steps to enter the windows\n",
+            WL_WINDOW_OVERLAP,this->wangLandauPrecision,this->wangLandauMaxSteps,this->heatup);
+        printf("#       dos: g(E) is saved to %s, normalized to 2^N if the range covers the whole spectrum\n",this->getDosFileName().c_str());
+    } else if (this->domains){
+        printf("#   domains: slabs along x, one per MPI rank, halves of slabs are updated in turn with halo exchange\n");
+        printf("#        MC: %u heatup, %u compute steps, measure every %u, temperatures one by one on %d ranks\n",
+            this->heatup, this->calculate, this->measureEvery, this->rankCount);
+    } else if (this->multiSpin>0){
+        printf("# multispin: %u replicas per temperature in words of 64 from random states, %u heatup, %u compute steps, measure every %u\n",
+            (this->multiSpin+63)/64*64, this->heatup, this->calculate, this->measureEvery);
+        printf("#    errors: spread between replicas\n");
+    } else {
+        if (this->autoHeatup)
+            printf("#        MC: automatic heatup (max. %u, drift test of %s), %u compute steps\n",
+                this->heatup, this->autoHeatupParameters ? "energy and parameters" : "energy", this->calculate);
+        else
+            printf("#        MC: %u heatup, %u compute steps\n",this->heatup,this->calculate);
+        printf("#   measure: every %u MC steps\n",this->measureEvery);
+        if (this->replicas>1)
+            printf("#  replicas: %u independent chains per temperature, comment lines #r<replica> are single chains\n",
+                this->replicas);
+        if (this->loops>0)
+            printf("#     loops: %u attempts after each MC step, strong bonds are >= %g of the strongest\n",
+                this->loops, this->loopThreshold);
+        if (this->nfold>0)
+            printf("#    n-fold: rejection-free dynamics when acceptance rate of MC step < %g\n",
+                this->nfold);
+        if (this->refine>0)
+            printf("#    refine: split intervals at the peak of %s or where it changes > %g of range, down to dT=%g\n",
+                this->refineParameter=="C" ? "C(T)" : ("susceptibility of "+this->refineParameter).c_str(),
+                REFINE_CHANGE, this->refine);
+        if (this->energyHistogram>0)
+            printf("# histogram: energy bins of %g with sums of parameters are saved to %s_hist_<temperature number>.txt\n",
+                this->energyHistogram, this->saveStateFileBasename.c_str());
+        if (this->precision>0)
+            printf("# precision: stop calculate when relative error of %s < %g, check every %u steps\n",
+                this->precisionParameter.c_str(), this->precision, PRECISION_CHECK_EVERY*this->measureEvery);
+        if (this->isRestart())
+            printf("#   restart: enabled, delta E threshold: %g*energy=%g\n",
+                this->getRestartThreshold(),
+                fabs(this->getRestartThreshold()*e));
+        else
+            printf("#   restart: disabled\n");
+        printf("#    errors: logarithmic binning, tau in measurements (0.5 means uncorrelated)\n");
+    }
+    if (this->rankCount>1 && this->population==0 && this->multiSpin==0 && this->wangLandau==0 && !this->domains)
+        printf("#   threads: %d per rank, %d MPI ranks take the temperatures dynamically, threadId=rank*%d+thread\n",
+            threadCount,this->rankCount,threadCount);
+    else
+        printf("#   threads: %d\n",threadCount);
+    if (this->validateEvery>0)
+        printf("#  validate: energy and parameters are recalculated on random steps, every %u on average, within %g of the time, drift > %g*|E| is reported\n",
+            this->validateEvery, this->validateBudget, this->validateTolerance);
+    if (this->affinity!="none")
+        printf("#  affinity: threads are pinned to cpus, %s\n",
+            this->affinity=="close" ? "close (sockets are filled one by one)" : "spread (neighbouring threads on different sockets)");
+    if (this->domains)
+        printf("#     rseed: %d+<temperature number>+<rank>*%d\n",this->seed,REPLICA_SEED_STRIDE);
+    else if (this->replicas>1 && this->population==0 && this->multiSpin==0)
+        printf("#     rseed: %d+<temperature number>+<replica number>*%d\n",this->seed,REPLICA_SEED_STRIDE);
     else
-        printf("#   restart: disabled\n");
-    printf("#   threads: %d\n",threadCount);
-    printf("#     rseed: %d+<temperature number>\n",this->seed);
+        printf("#     rseed: %d+<temperature number>\n",this->seed);
     printf("#    temps.: %zd pcs. from %e to %e\n",
         temperatures.size(),
         std::min_element(temperatures.begin(),temperatures.end()).operator*(),
@@ -317,8 +660,26 @@ void ConfigManager::printHeader()
         printf(" %d:<E^4>",i);
         i+=1;
     }
-    printf(" %d:threadId %d:seed",i,i+1);
-    i+=2;
+    if (this->population>0){
+        printf(" %d:F/N %d:families",i,i+1);
+        i+=2;
+    } else if (this->multiSpin>0){
+        printf(" %d:replicas %d:seed",i,i+1);
+        i+=2;
+    } else if (this->wangLandau>0){
+        printf(" %d:F/N",i);
+        i+=1;
+    } else if (this->domains){
+        printf(" %d:ranks %d:seed %d:<|M|> %d:<|M|^2>",i,i+1,i+2,i+3);
+        i+=4;
+        if(this->isBinder()){
+            printf(" %d:<|M|^4>",i);
+            i+=1;
+        }
+    } else {
+        printf(" %d:threadId %d:seed",i,i+1);
+        i+=2;
+    }
 
     for (auto & co : parameters){
         printf(" %d:<%s> %d:<%s^2>",i,co->parameterId().c_str(),i+1,co->parameterId().c_str());
@@ -329,6 +690,22 @@ void ConfigManager::printHeader()
         }
     }
     printf(" %d:time,s",i);
+    ++i;
+    if (this->multiSpin>0){
+        printf(" %d:err(C(T)/N) %d:err(<E>)",i,i+1);
+        i+=2;
+    } else if (this->population==0 && this->wangLandau==0){
+        printf(" %d:err(C(T)/N) %d:err(<E>) %d:tau(E)",i,i+1,i+2);
+        i+=3;
+        if (this->domains){
+            printf(" %d:err(<|M|>) %d:tau(|M|)",i,i+1);
+            i+=2;
+        }
+        for (auto & co : parameters){
+            printf(" %d:err(<%s>) %d:tau(%s)",i,co->parameterId().c_str(),i+1,co->parameterId().c_str());
+            i+=2;
+        }
+    }
     printf("\n");
     fflush(stdout);
 }
@@ -338,24 +715,61 @@ void ConfigManager::applyState(string s)
     this->system.state.fromString(s);
     this->system.state.hardReset();
     this->system.setInteractionRange(this->range);
+    this->prepareSystem(this->system);
+
+    // signs and moments of the parameters are relative to the initial state, which is changed now
+    for (auto & co : this->parameters)
+        co->rebuild();
+    shareMagnetisationVectors(this->parameters);
+    for (auto & co : this->parameters)
+        co->init(&this->system);
+}
+
+void ConfigManager::prepareSystem(PartArray & sys) const
+{
     if (this->isCSV()){
-        ConfigManager::setCSVEnergies(this->system);
+        ConfigManager::setCSVEnergies(sys);
     } else {
         if (this->isPBC())
         {
-            ConfigManager::setPBCEnergies(this->system);
+            ConfigManager::setPBCEnergies(sys);
         }
     }
 }
 
+double ConfigManager::energy(PartArray & sys) const
+{
+    double e = sys.E();
+    for (auto p : sys.parts)
+    {
+        e -= p->m.scalar(this->field);
+    }
+    return e;
+}
+
 void ConfigManager::getParameters(std::vector< std::unique_ptr< CalculationParameter > > & calculationParameters)
 {
     for (auto & co : parameters){
         calculationParameters.push_back(std::unique_ptr<CalculationParameter>(co->copy()));
     }
+    shareMagnetisationVectors(calculationParameters);
     return;
 }
 
+void ConfigManager::getSubscriptions(std::vector<unsigned> & offsets, std::vector<unsigned> & subscriptions) const
+{
+    const unsigned N = this->system.size();
+    offsets.assign(N+1, 0);
+    subscriptions.clear();
+    for (unsigned i=0; i<N; ++i){
+        for (unsigned k=0; k<this->parameters.size(); ++k){
+            if (this->parameters[k]->affects(i))
+                subscriptions.push_back(k);
+        }
+        offsets[i+1] = subscriptions.size();
+    }
+}
+
 void ConfigManager::setPBCEnergies(PartArray & sys)
 {
     // first update all neighbours
@@ -435,16 +849,10 @@ void ConfigManager::setCSVEnergies(PartArray & sys)
     // first update all neighbours
     sys.neighbours.clear();
     sys.neighbours.resize(sys.parts.size());
-    auto a = sys.parts.begin();
-    for (auto line : ConfigManager::energyTable){
-        auto b = sys.parts.begin();
-        for (double cell : line){
-            if ( cell != 0.0 ){
-                sys.neighbours[(*a)->Id()].push_front(*b);
-            }
-            b++;
+    for (size_t i = 0; i < ConfigManager::energyTable.size(); i++){
+        for (const auto & cell : ConfigManager::energyTable[i]){
+            sys.neighbours[sys.parts[i]->Id()].push_front(sys.parts[cell.first]);
         }
-        a++;
     }
 
     sys.changeSystem();
@@ -455,5 +863,9 @@ void ConfigManager::setCSVEnergies(PartArray & sys)
 
 double hamiltonianDipolarCSV(Part *b, Part *a)
 {
-    return ConfigManager::energyTable[a->Id()][b->Id()] * a->m.x * b->m.x;
+    const auto & row = ConfigManager::energyTable[a->Id()];
+    auto cell = lower_bound(row.begin(), row.end(), b->Id(), [](const pair<unsigned,double> & c, unsigned id){ return c.first < id; });
+    if (cell == row.end() || cell->first != b->Id())
+        return 0;
+    return cell->second * a->m.x * b->m.x;
 }
\ No newline at end of file
@@ -16,6 +16,7 @@
 #include "CorrelationPointCore.h"
 #include "MagnetisationCore.h"
 #include "MagnetisationLengthCore.h"
+#include "StructureFactorCore.h"
 #include "misc.h"
 
 static const std::map<std::string, unsigned> methods = 
@@ -30,10 +31,13 @@ class ConfigManager
 {
 public:
     bool check_config();
-    static ConfigManager init(const CommandLineParameters & commandLineParameters, const inicpp::config & iniconfig);
+    // with domains the system is loaded by the root rank only
+    static ConfigManager init(const CommandLineParameters & commandLineParameters, const inicpp::config & iniconfig, bool root = true);
 
     void printHeader();
     void getParameters(std::vector< std::unique_ptr< CalculationParameter > > &);
+    // numbers of the parameters affected by the flip of spin i are in [offsets[i],offsets[i+1])
+    void getSubscriptions(std::vector<unsigned> & offsets, std::vector<unsigned> & subscriptions) const;
 
     const PartArray & getSystem(){return this->system;}
     void saveSystem(std::string filename){ return this->system.save(filename); }
@@ -46,6 +50,24 @@ public:
     unsigned N() const { return this->system.size(); }
     unsigned getHeatup() { return this->heatup; }
     unsigned getCalculate() { return this->calculate; }
+    unsigned getMeasureEvery() const { return this->measureEvery; }
+    unsigned getPopulation() const { return this->population; }
+    unsigned getMultiSpin() const { return this->multiSpin; }
+    unsigned getReplicas() const { return this->replicas; }
+    double getRefine() const { return this->refine; }
+    std::string getRefineParameter() const { return this->refineParameter; }
+    double getEnergyHistogram() const { return this->energyHistogram; }
+    unsigned getWangLandau() const { return this->wangLandau; }
+    double getWangLandauEmin() const { return this->wangLandauEmin; }
+    double getWangLandauEmax() const { return this->wangLandauEmax; }
+    unsigned getWangLandauWindows() const { return this->wangLandauWindows; }
+    double getWangLandauPrecision() const { return this->wangLandauPrecision; }
+    unsigned getWangLandauMaxSteps() const { return this->wangLandauMaxSteps; }
+    unsigned getLoops() const { return this->loops; }
+    double getLoopThreshold() const { return this->loopThreshold; }
+    double getNFold() const { return this->nfold; }
+    unsigned getPopulationSweeps() const { return this->populationSweeps; }
+    unsigned getParametersCount() const { return this->parameters.size(); }
     std::string getSysfile() { return this->sysfile; }
     const Vect & getField() const { return this->field; }
     bool isPBC() const { return this->pbc; }
@@ -53,6 +75,16 @@ public:
     bool isBinder() const { return this->_binder; }
     bool isRestart() const {return this->restart; }
     double getRestartThreshold() const {return this->restartThreshold; }
+    double getPrecision() const { return this->precision; }
+    bool isAutoHeatup() const { return this->autoHeatup; }
+    bool isDomains() const { return this->domains; }
+    double getRange() const { return this->range; }
+    std::string getAffinity() const { return this->affinity; }
+    unsigned getValidateEvery() const { return this->validateEvery; }
+    double getValidateTolerance() const { return this->validateTolerance; }
+    double getValidateBudget() const { return this->validateBudget; }
+    bool isAutoHeatupParameters() const { return this->autoHeatupParameters; }
+    std::string getPrecisionParameter() const { return this->precisionParameter; }
     std::string getNewGSFilename() {return this->newGSFilename; }
     inline unsigned getSaveStates() { return this->saveStates; }
     inline unsigned getSaveShort() { return this->saveShort; }
@@ -62,15 +94,27 @@ public:
     std::string getSaveShortFileName(int temperature){ 
         return this->saveStateFileBasename+"_"+std::to_string(temperature)+".txt"; 
     }
+    std::string getHistogramFileName(int temperature){ 
+        return this->saveStateFileBasename+"_hist_"+std::to_string(temperature)+".txt"; 
+    }
+    std::string getDosFileName(){ 
+        return this->saveStateFileBasename+"_dos.txt"; 
+    }
 
     bool debug = false;
     int threadCount=0;
+    int rankCount=1;
     static Vect size;
-    static vector < vector < double > > energyTable;
+    static SparseTable energyTable;
 
     static void setPBCEnergies(PartArray & sys);
     static void setCSVEnergies(PartArray & sys);
 
+    // set the neighbours and hamiltonian of the system copy according to config
+    void prepareSystem(PartArray & sys) const;
+    // full energy of the system including external field
+    double energy(PartArray & sys) const;
+
 private:
     ConfigManager(){};
 
@@ -80,11 +124,37 @@ private:
     bool _binder = 0;
     unsigned heatup = 0;
     unsigned calculate = 0;
+    unsigned measureEvery = 1;
+    unsigned population = 0;
+    unsigned multiSpin = 0;
+    unsigned replicas = 1;
+    double energyHistogram = 0;
+    double refine = 0;
+    std::string refineParameter = "C";
+    unsigned wangLandau = 0;
+    double wangLandauEmin = NAN;
+    double wangLandauEmax = NAN;
+    unsigned wangLandauWindows = 0;
+    double wangLandauPrecision = 1e-6;
+    unsigned wangLandauMaxSteps = 100000000;
+    unsigned loops = 0;
+    double loopThreshold = 0.5;
+    double nfold = 0;
+    unsigned populationSweeps = 10;
     double range = 0;
     int seed = 0;
     Vect field;
     bool restart = true;
     double restartThreshold = 1e-6;
+    double precision = 0;
+    bool autoHeatup = 0;
+    bool domains = 0;
+    std::string affinity = "none";
+    unsigned validateEvery = 0;
+    double validateTolerance = 1e-10;
+    double validateBudget = 0.01;
+    bool autoHeatupParameters = 0;
+    std::string precisionParameter = "C";
     unsigned saveStates = 0;
     unsigned saveShort = 0;
     std::string saveStateFileBasename;
@@ -1,5 +1,8 @@
 #include "CorrelationCore.h"
 
+#include <cmath>
+#include <algorithm>
+
 CorrelationCore::CorrelationCore(
     const std::string & parameterId,
     PartArray * prototype,
@@ -11,21 +14,82 @@ CalculationParameter(parameterId, prototype),
 _minRange(minRange),
 _maxRange(maxRange),
 _methodVar(methodVar),
-spins(spins),
 cp(0,1024*8),
 cp2(0,2048*8),
 cp4(0,3072*8)
 {
-    minRange2 = _minRange*_minRange;
-    maxRange2 = _maxRange*_maxRange;
-    if (this->spins.size() == 0) {
-        this->spins.resize(this->prototype->size(),0);
-        for (uint64_t i=0; i<this->prototype->size(); ++i) this->spins[i]=i;
-    }
+    this->buildPlan(spins);
 
     this->prototypeInit(prototype);
 }
 
+void CorrelationCore::buildPlan(std::vector<uint64_t> spins)
+{
+    if (this->_methodVar>2)
+        throw(invalid_argument("Invalid _methodVar values found in CorrelationCore::buildPlan"));
+
+    const unsigned N = this->prototype->size();
+    if (spins.size() == 0) {
+        spins.resize(N,0);
+        for (uint64_t i=0; i<N; ++i) spins[i]=i;
+    }
+    std::vector<char> selected(N,0);
+    for (auto s: spins)
+        selected[s] = 1;
+    std::vector<unsigned> ids;
+    for (unsigned i=0; i<N; ++i)
+        if (selected[i]) ids.push_back(i);
+
+    // the pair is correlated if at least one of its spins is selected, both directions are kept.
+    // Only the selected spins are scanned, O(|spins|*N)
+    const double minRange2 = _minRange*_minRange;
+    const double maxRange2 = _maxRange*_maxRange;
+    std::vector< std::vector<unsigned> > found(N);
+    std::vector< std::vector<signed char> > signs(N);
+#pragma omp parallel for schedule(dynamic,64)
+    for (int k=0; k<(int)ids.size(); ++k){
+        const unsigned i = ids[k];
+        Part* partA = this->prototype->parts[i];
+        for (unsigned j=0; j<N; ++j){
+            if (j==i)
+                continue;
+            Part* partB = this->prototype->parts[j];
+            const double space2 = partA->pos.space_2(partB->pos);
+            if (space2>=minRange2 && space2<=maxRange2){
+                found[i].push_back(j);
+                signs[i].push_back(this->initValue(partA,partB));
+            }
+        }
+    }
+
+    // the other direction of the pairs with one selected spin, in the order of the selected spins
+    for (unsigned i: ids){
+        for (unsigned j: found[i]){
+            if (selected[j])
+                continue;
+            found[j].push_back(i);
+            signs[j].push_back(this->initValue(this->prototype->parts[j],this->prototype->parts[i]));
+        }
+    }
+
+    auto p = std::make_shared<Plan>();
+    p->spins.swap(spins);
+    p->offsets.resize(N+1,0);
+    for (unsigned i=0; i<N; ++i)
+        p->offsets[i+1] = p->offsets[i] + found[i].size();
+    p->neighbours.reserve(p->offsets[N]);
+    p->values.reserve(p->offsets[N]);
+    p->interactingSpins = 0;
+    for (unsigned i=0; i<N; ++i){
+        p->neighbours.insert(p->neighbours.end(), found[i].begin(), found[i].end());
+        p->values.insert(p->values.end(), signs[i].begin(), signs[i].end());
+        if (!found[i].empty())
+            ++p->interactingSpins;
+    }
+    p->correlationPairsNum = p->offsets[N]/2.;
+    this->plan = p;
+}
+
 bool CorrelationCore::check(unsigned N) const
 {
     /*if (cctemp.correlationPairsNum==0){
@@ -38,19 +102,14 @@ bool CorrelationCore::check(unsigned N) const
 
 void CorrelationCore::printHeader(unsigned num) const
 {
+    const Plan & p = *this->plan;
     printf("##### calculation param #%d #####\n",num);
     printf("# type: correlation\n");
     printf("# id: %s\n",this->parameterId().c_str());
-    
-    int totalInteractingSpins = 0;
-    for (int i=0; i<this->prototype->size(); ++i){
-        if (!this->correlationNeighbours[i].empty())
-            ++totalInteractingSpins;
-    }
 
     printf("# minimal interaction distance: %.2f\n",this->_minRange);
     printf("# maximal interaction distance: %.2f\n",this->_maxRange);
-    printf("# average neighbours: %.2f\n",this->correlationPairsNum/double(totalInteractingSpins)*2);
+    printf("# average neighbours: %.2f\n",p.correlationPairsNum/double(p.interactingSpins)*2);
     if (this->_methodVar==0)
         printf("# method: XOR\n");
     if (this->_methodVar==1)
@@ -59,174 +118,116 @@ void CorrelationCore::printHeader(unsigned num) const
         printf("# method: scalar\n");
     
     printf("# spins: ");
-    if (this->spins.size() == this->prototype->size()){
+    if (p.spins.size() == this->prototype->size()){
         printf("All\n");
     } else {
-        printf("%lu",this->spins[0]);
-        for (int ss=1; ss<this->spins.size(); ++ss){
-            printf(",%lu",this->spins[ss]);
+        printf("%lu",p.spins[0]);
+        for (int ss=1; ss<p.spins.size(); ++ss){
+            printf(",%lu",p.spins[ss]);
         }
         printf("\n");
     }
 
     printf("#\n");
-    
-}
-
-bool CorrelationCore::init(PartArray * sys)
-{
-
-    //reset
-    correlationNeighbours.clear();
-    correlationValues.clear();
-    correlationPairsNum=0;
-    
-    this->sys = sys;
-    correlationNeighbours.resize(sys->size());
-
-    for (auto paId: this->spins){
-        auto partA = sys->getById(paId);
-        for (auto partB: sys->parts){
-            if (partA==partB)
-                continue;
-            
-            double space2 = partA->pos.space_2(partB->pos);
-
-            if (space2>=this->minRange2 && space2<=this->maxRange2){
-                if (!areNeighbours(partA,partB)){
-                    switch (this->_methodVar)
-                    {
-                        case 0: this->initMethod1(partA,partB); break;
-                        case 1: this->initMethod2(partA,partB); break;
-                        case 2: this->initMethod3(partA,partB); break;
-                    }
-                }
-                if (!areNeighbours(partB,partA)){
-                    switch (this->_methodVar)
-                    {
-                        case 0: this->initMethod1(partB,partA); break;
-                        case 1: this->initMethod2(partB,partA); break;
-                        case 2: this->initMethod3(partB,partA); break;
-                    }
-                }
-            }
-        }
-    }
-    this->correlationPairsNum/=2;
 
     if (_debug){
-        for (auto partA : this->sys->parts){
-            if (!this->correlationNeighbours[partA->Id()].empty()){
-                fprintf(stderr,"# neigh for %ld: ",partA->Id());
-                for (auto partB:this->correlationNeighbours[partA->Id()]){
-                    fprintf(stderr,"%ld,",partB->Id());
+        for (unsigned i=0; i<this->prototype->size(); ++i){
+            if (p.offsets[i+1] > p.offsets[i]){
+                fprintf(stderr,"# neigh for %u: ",i);
+                for (unsigned k=p.offsets[i]; k<p.offsets[i+1]; ++k){
+                    fprintf(stderr,"%u,",p.neighbours[k]);
                 }
                 fprintf(stderr,"\n");
             }
         }
     }
+}
 
+bool CorrelationCore::init(PartArray * sys)
+{
+    // the plan is shared, only the current value belongs to the chain
+    this->sys = sys;
     this->cpOld = this->getFullTotal(this->sys);
 
     return true;
 }
 
 void CorrelationCore::iterate(unsigned id){
-    for (auto partB:this->correlationNeighbours[id]){
-        this->cpOld += 2*this->method(this->sys->getById(id),partB);
-    }
-
-
-    if (_debug){
-        long res = this->getFullTotal(this->sys);
-        if (res!=this->cpOld) 
-            cerr<<"# (dbg CorrelationCore#"<<this->parameterId()<<") total value is different: iterative="<<this->cpOld<<", full="<<res<<endl;
+    const Plan & p = *this->plan;
+    const bool stateA = this->sys->parts[id]->state;
+    for (unsigned k=p.offsets[id]; k<p.offsets[id+1]; ++k){
+        const char sign = (stateA ^ this->sys->parts[p.neighbours[k]]->state)?-1:+1;
+        this->cpOld += 2*sign*p.values[k];
     }
 }
 
-void CorrelationCore::incrementTotal(){
-    double addVal = double(this->cpOld)/this->correlationPairsNum;
-    this->cp += addVal;
-    this->cp2 += addVal*addVal;
-    if (this->_binder)
-        this->cp4 += addVal*addVal*addVal*addVal;
+bool CorrelationCore::affects(unsigned id) const
+{
+    return this->plan->offsets[id+1] > this->plan->offsets[id];
 }
 
-long CorrelationCore::getFullTotal(const PartArray * _sys) const
+double CorrelationCore::mismatch() const
 {
-
-    long res=0;
-    for (auto partA : _sys->parts){
-        for (auto partB:this->correlationNeighbours[partA->Id()]){
-            res += this->method(partA, partB);
-        }
-
-    }
-    return res/2;
+    const long res = this->getFullTotal(this->sys);
+    return fabs(double(res - this->cpOld)) / std::max(1., fabs(double(res)));
 }
 
-char CorrelationCore::method(const Part* partA, const Part* partB) const
+double CorrelationCore::value() const
 {
-    if (this->_methodVar==0) return fxor(partA,partB);
-    if (this->_methodVar==1) return feSign(partA,partB);
-    if (this->_methodVar==2) return fScalar(partA,partB);
-
-    throw(invalid_argument("Invalid _methodVar values found in CorrelationCore::method"));
-    return 0;
+    return double(this->cpOld)/this->plan->correlationPairsNum;
 }
 
-// functions for correlation options
-char CorrelationCore::fxor(const Part* partA,const Part* partB) const
+void CorrelationCore::update()
 {
-    return (partA->state ^ partB->state)?-1:+1;
+    this->cpOld = this->getFullTotal(this->sys);
 }
-char CorrelationCore::feSign(const Part* partA, const Part* partB) const
+
+double CorrelationCore::iterateCost() const
 {
-    return fxor(partA,partB) * 
-        this->correlationValues.at(std::make_pair(partA->Id(),partB->Id()));
+    // only the spins with neighbours are iterated
+    return (this->plan->interactingSpins + this->plan->correlationPairsNum * 2.) / this->sys->size();
 }
-char CorrelationCore::fScalar(const Part* partA, const Part* partB) const
+
+double CorrelationCore::updateCost() const
 {
-    return fxor(partA,partB) * 
-        this->correlationValues.at(std::make_pair(partA->Id(),partB->Id()));
+    return this->sys->size() + this->plan->correlationPairsNum * 2.;
 }
 
-void CorrelationCore::initMethod1(Part* partA, Part* partB){
-    this->correlationNeighbours[partA->Id()].push_front(partB);
-    ++correlationPairsNum;
+void CorrelationCore::incrementTotal(){
+    double addVal = this->value();
+    this->cp += addVal;
+    this->_binning.add(addVal);
+    this->cp2 += addVal*addVal;
+    if (this->_binder)
+        this->cp4 += addVal*addVal*addVal*addVal;
 }
 
-void CorrelationCore::initMethod2( Part* partA, Part* partB){
-    double eTemp;
-    
-    this->correlationNeighbours[partA->Id()].push_front(partB);
-    ++correlationPairsNum;
-
-    //В матрицу надо помещать энергии только в неперевернутых состояниях
-    eTemp = hamiltonianDipolar(partA,partB)*-1; 
-    if (partA->state!=partB->state)
-        eTemp*=-1.;
-
-    if (eTemp>0)
-        this->correlationValues[std::make_pair(partA->Id(),partB->Id())] = 1;
-    else
-        this->correlationValues[std::make_pair(partA->Id(),partB->Id())] = -1;
+long CorrelationCore::getFullTotal(const PartArray * _sys) const
+{
+    const Plan & p = *this->plan;
+    long res=0;
+    for (unsigned i=0; i<_sys->size(); ++i){
+        const bool stateA = _sys->parts[i]->state;
+        for (unsigned k=p.offsets[i]; k<p.offsets[i+1]; ++k){
+            res += ((stateA ^ _sys->parts[p.neighbours[k]]->state)?-1:+1) * p.values[k];
+        }
+    }
+    return res/2;
 }
 
-void CorrelationCore::initMethod3( Part* partA, Part* partB){
-    double eTemp;
-    
-    this->correlationNeighbours[partA->Id()].push_front(partB);
-    ++correlationPairsNum;
+signed char CorrelationCore::initValue(Part* partA, Part* partB) const
+{
+    if (this->_methodVar==0)
+        return 1;
 
     //В матрицу надо помещать энергии только в неперевернутых состояниях
-    eTemp = partA->m.scalar(partB->m); 
+    double eTemp;
+    if (this->_methodVar==1)
+        eTemp = hamiltonianDipolar(partA,partB)*-1;
+    else
+        eTemp = partA->m.scalar(partB->m);
     if (partA->state!=partB->state)
         eTemp*=-1.;
 
-
-    if (eTemp>0)
-        this->correlationValues[std::make_pair(partA->Id(),partB->Id())] = 1;
-    else
-        this->correlationValues[std::make_pair(partA->Id(),partB->Id())] = -1;
-}
\ No newline at end of file
+    return (eTemp>0) ? 1 : -1;
+}
@@ -4,6 +4,7 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>
 #include <gmpxx.h>
 #include <cstdint>
 #include "PartArray.h"
@@ -14,9 +15,19 @@ class CorrelationCore: public CalculationParameter
 {
 
 public:
-    std::vector< std::forward_list < Part* > > correlationNeighbours;
-    std::map< std::pair<unsigned, unsigned>, short > correlationValues;
-    double correlationPairsNum;
+    /**
+     * @brief Pairs of the correlation and their signs. They depend only on the geometry and the initial state,
+     * so the plan is built once by the prototype and shared read-only by the copies of all chains.
+     */
+    struct Plan {
+        std::vector<uint64_t> spins;
+        // neighbours of spin i are in [offsets[i],offsets[i+1]), values are the signs of the pairs in the initial state
+        std::vector<unsigned> offsets;
+        std::vector<unsigned> neighbours;
+        std::vector<signed char> values;
+        double correlationPairsNum;
+        unsigned interactingSpins;
+    };
 
     CorrelationCore(
         const std::string & parameterId,
@@ -29,9 +40,16 @@ public:
     virtual bool check(unsigned) const;
     virtual void printHeader(unsigned) const;
     virtual bool init(PartArray * sys);
+    virtual void rebuild() { this->buildPlan(this->plan->spins); }
 
     virtual void iterate(unsigned id);
+    virtual bool affects(unsigned id) const;
     virtual void incrementTotal();
+    virtual double value() const;
+    virtual void update();
+    virtual double mismatch() const;
+    virtual double iterateCost() const;
+    virtual double updateCost() const;
     virtual mpf_class getTotal(unsigned steps){ return this->cp / steps;}
     virtual mpf_class getTotal2(unsigned steps){ return this->cp2 / steps;}
     virtual mpf_class getTotal4(unsigned steps){ return this->cp4 / steps;}
@@ -40,36 +58,21 @@ public:
 
 
 private:
-    char method(const Part* partA, const Part* partB) const;
-    char fxor(const Part* partA, const Part* partB) const;
-    char feSign(const Part* partA, const Part* partB) const;
-    char fScalar(const Part* partA, const Part* partB) const;
-
-
-    void initMethod1(Part* partA, Part* partB);
-    void initMethod2( Part* partA, Part* partB);
-    void initMethod3( Part* partA, Part* partB);
+    // sign of the pair (partA,partB) in the initial state, for the chosen method
+    signed char initValue(Part* partA, Part* partB) const;
+    void buildPlan(std::vector<uint64_t> spins);
 
     long getFullTotal(const PartArray * _sys) const;
 
-    double minRange2;
-    double maxRange2;
-
     double _minRange;
     double _maxRange;
     unsigned _methodVar;
-    std::vector<uint64_t> spins;
+    std::shared_ptr<const Plan> plan;
 
     mpf_class cp;
     mpf_class cp2;
     mpf_class cp4;
     long cpOld;
-
-    bool areNeighbours(Part* partA, Part* partB)
-    { 
-        std::forward_list < Part* > &tmp = correlationNeighbours[partA->Id()];
-        return std::find(tmp.begin(), tmp.end(), partB) != tmp.end();
-    }
 };
 
 #endif //CORELLATIONCORE_H
\ No newline at end of file
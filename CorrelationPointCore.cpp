@@ -1,5 +1,8 @@
 #include "CorrelationPointCore.h"
 
+#include <cmath>
+#include <algorithm>
+
 // @todo Сейчас в correlationNeighbours хранятся все соседи для каждого спина. 
 // Но спин может принадлежать сразу нескольким кореляционным точкам, и тогда будет иметь разных соседей.
 
@@ -20,9 +23,86 @@ cp4(0,3076*8),
 _histogramEnabled(false),
 _histogramFilename("")
 {
+    this->buildPlan();
+
     this->prototypeInit(prototype);
 }
 
+void CorrelationPointCore::buildPlan()
+{
+    const unsigned N = this->prototype->size();
+    const unsigned P = this->pointCount();
+    const double dist2 = this->_distance * this->_distance;
+    const double minr2 = this->_minRange * this->_minRange;
+    const double maxr2 = this->_maxRange * this->_maxRange;
+
+    auto p = std::make_shared<Plan>();
+    p->pointSpins.resize(P);
+    p->pointPairs.resize(P);
+
+    //first find the spins around each point, then the neighbours inside it
+#pragma omp parallel for schedule(dynamic,1)
+    for (int i=0; i<(int)P; ++i){
+        Vect point = Vect(X[i],Y[i],0);
+        for (unsigned s=0; s<N; ++s){
+            if (point.space_2(this->prototype->parts[s]->pos)<=dist2)
+                p->pointSpins[i].push_back(s);
+        }
+        for (unsigned a: p->pointSpins[i]){
+            Part* partA = this->prototype->parts[a];
+            for (unsigned b: p->pointSpins[i]){
+                if (a==b)
+                    continue;
+                Part* partB = this->prototype->parts[b];
+                double space2 = partA->pos.space_2(partB->pos);
+                if (space2>=minr2 && space2<=maxr2){
+                    //В матрицу надо помещать энергии только в неперевернутых состояниях
+                    double eTemp = hamiltonianDipolar(partA,partB)*-1; 
+                    if (partA->state!=partB->state)
+                        eTemp*=-1.;
+                    p->pointPairs[i].push_back({a, b, (signed char)((eTemp>0) ? 1 : -1)});
+                }
+            }
+        }
+    }
+
+    p->spinsInPoint = 0;
+    p->maxSpinsInPoint = 0;
+    for (unsigned i=0; i<P; ++i){
+        if (p->pointSpins[i].empty()){
+            throw(std::invalid_argument("# Corellation point "+std::to_string(i)+" has no spins around. Check your config."));
+        }
+        p->spinsInPoint += p->pointSpins[i].size();
+        p->maxSpinsInPoint = std::max<unsigned>(p->maxSpinsInPoint, p->pointSpins[i].size());
+    }
+    p->spinsInPoint /= P;
+
+    // the spin in several points has the neighbours of all of them
+    p->offsets.assign(N+1,0);
+    for (auto & pairs: p->pointPairs)
+        for (auto & pair: pairs)
+            ++p->offsets[pair.a+1];
+    for (unsigned i=0; i<N; ++i)
+        p->offsets[i+1] += p->offsets[i];
+    p->neighbours.resize(p->offsets[N]);
+    p->values.resize(p->offsets[N]);
+    std::vector<unsigned> filled(p->offsets.begin(), p->offsets.end()-1);
+    for (auto & pairs: p->pointPairs){
+        for (auto & pair: pairs){
+            p->neighbours[filled[pair.a]] = pair.b;
+            p->values[filled[pair.a]] = pair.value;
+            ++filled[pair.a];
+        }
+    }
+    p->correlationPairsNum = p->offsets[N]/2;
+    p->interactingSpins = 0;
+    for (unsigned i=0; i<N; ++i){
+        if (p->offsets[i+1] > p->offsets[i])
+            ++p->interactingSpins;
+    }
+    this->plan = p;
+}
+
 bool CorrelationPointCore::check(unsigned N) const
 {
     if (this->X.size() != this->Y.size()){
@@ -31,7 +111,7 @@ bool CorrelationPointCore::check(unsigned N) const
                 return false;
         }
 
-    /*if (this->correlationPairsNum==0){
+    /*if (this->plan->correlationPairsNum==0){
             cerr<<"Check the correlation point ranges."<<endl;
             cerr<<"Could not find any spin pairs within this distance!"<<endl;
             return false;
@@ -42,7 +122,7 @@ bool CorrelationPointCore::check(unsigned N) const
 
 void CorrelationPointCore::printHeader(unsigned num) const
 {
-
+    const Plan & p = *this->plan;
 
     printf("##### calculation param #%d #####\n",num);
     printf("# type: correlationpoint\n");
@@ -58,32 +138,30 @@ void CorrelationPointCore::printHeader(unsigned num) const
 
     printf("# points: %zd; (%.2f avg spins per point, %.2f avg. neighbours per spin)\n",
             this->X.size(),
-            this->spinsInPoint,
-            this->correlationPairsNum*2./double(this->spinsInvolvedCount()));
+            p.spinsInPoint,
+            p.correlationPairsNum*2./double(this->spinsInvolvedCount()));
     printf("#    coordinates: format is <num:(x,y):spins>, <...>, ...\n");
-    printf("# 0:(%f,%f):%ld",
+    printf("# 0:(%f,%f):%zd",
         this->X[0],
         this->Y[0],
-        std::distance(this->correlationPointSpins[0].begin(),
-                        this->correlationPointSpins[0].end()));
+        p.pointSpins[0].size());
     for (int i=1; i<this->X.size(); ++i)
-        printf(", %d:(%f,%f):%ld",i,
+        printf(", %d:(%f,%f):%zd",i,
             this->X[i],
             this->Y[i],
-            std::distance(this->correlationPointSpins[i].begin(),
-                        this->correlationPointSpins[i].end()));
+            p.pointSpins[i].size());
     printf("\n");
 
     printf("#\n");
 
     if (_debug) {
         fprintf(stderr,"# (debug) spins (and its neighbours in brackets) for each point:\n");
-        for (size_t i=0; i < this->correlationPointSpins.size(); i++){
+        for (size_t i=0; i < p.pointSpins.size(); i++){
             fprintf(stderr,"# point %zd: ", i);
-            for (auto s : this->correlationPointSpins[i]){
-                fprintf(stderr,"%zd (", s->Id());
-                for (auto n : this->correlationNeighbours[s->Id()]){
-                    fprintf(stderr,"%zd,",n->Id());
+            for (auto s : p.pointSpins[i]){
+                fprintf(stderr,"%u (", s);
+                for (unsigned k=p.offsets[s]; k<p.offsets[s+1]; ++k){
+                    fprintf(stderr,"%u,",p.neighbours[k]);
                 }
                 fprintf(stderr,"), ");
             }
@@ -96,90 +174,12 @@ void CorrelationPointCore::printHeader(unsigned num) const
 
 bool CorrelationPointCore::init(PartArray * sys)
 {
-
-    // clear variables
-    correlationPointSpins.clear();
-    correlationNeighbours.clear();
-    correlationValues.clear();
-    correlationPairsNum=0;
-    spinsInPoint=0;
-
-    
+    // the plan is shared, only the current value and the histogram belong to the chain
     this->sys = sys;
-
-    correlationPointSpins.resize(X.size());
-    correlationNeighbours.resize(sys->size());
-    double space2;
-
-    if (this->_histogramEnabled){
-        correlationNeighboursByPoint.resize(X.size());
-        for (auto &cps: this->correlationNeighboursByPoint){
-            cps.resize(sys->size());
-        }
-    }
-
-    //first find the spins around each point
-    double dist2 = this->_distance * this->_distance;
-    unsigned maxSpinsInPoint=0;
-    for (int i=0; i<X.size(); ++i){
-        Vect point = Vect(X[i],Y[i],0);
-        unsigned spinsInCurrentPoint = 0;
-        for (auto part: sys->parts){
-            space2 = point.space_2(part->pos);
-            if (space2<=dist2){
-                this->correlationPointSpins[i].push_front(part);
-                ++spinsInCurrentPoint;
-            }
-        }
-        if (spinsInCurrentPoint==0){
-            throw(std::invalid_argument("# Corellation point "+std::to_string(i)+" has no spins around. Check your config."));
-        }
-        spinsInPoint += spinsInCurrentPoint;
-        if (spinsInCurrentPoint > maxSpinsInPoint)
-            maxSpinsInPoint = spinsInCurrentPoint;
-    }
-    spinsInPoint /= this->pointCount();
-
-    const double minr2 = this->_minRange * this->_minRange;
-    const double maxr2 = this->_maxRange * this->_maxRange;
-    double eTemp;
-
-    int i=0;
-    //find neighbours in all corellation points
-    for (auto cps: this->correlationPointSpins){
-        for (auto partA: cps){
-            for (auto partB: cps){
-                if (partA==partB)
-                    continue;
-                
-                space2 = partA->pos.space_2(partB->pos);
-                if (space2>=minr2 && space2<=maxr2){
-                    this->correlationNeighbours[partA->Id()].push_front(partB);
-                    ++correlationPairsNum;
-                    
-                    if (this->_histogramEnabled){
-                        this->correlationNeighboursByPoint[i][partA->Id()].push_front(partB);
-                    }
-
-                    //В матрицу надо помещать энергии только в неперевернутых состояниях
-                    eTemp = hamiltonianDipolar(partA,partB)*-1; 
-                    if (partA->state!=partB->state)
-                        eTemp*=-1.;
-
-                    if (eTemp>0)
-                        this->correlationValues[std::make_pair(partA->Id(),partB->Id())] = 1;
-                    else
-                        this->correlationValues[std::make_pair(partA->Id(),partB->Id())] = -1;
-                }
-            }
-        }
-        ++i;
-    }
-    this->correlationPairsNum/=2;
-
     this->cpOld = this->getFullTotal(this->sys);
 
     if (this->_histogramEnabled){
+        const int maxSpinsInPoint = this->plan->maxSpinsInPoint;
         dos.resize(-maxSpinsInPoint,maxSpinsInPoint,maxSpinsInPoint*2+1);
         dos.clear();
     }
@@ -188,47 +188,74 @@ bool CorrelationPointCore::init(PartArray * sys)
 }
 
 void CorrelationPointCore::iterate(unsigned id){
-    for (auto partB:this->correlationNeighbours[id]){
-        this->cpOld += 2*this->method(this->sys->getById(id),partB);
+    const Plan & p = *this->plan;
+    const bool stateA = this->sys->parts[id]->state;
+    for (unsigned k=p.offsets[id]; k<p.offsets[id+1]; ++k){
+        const short sign = (stateA ^ this->sys->parts[p.neighbours[k]]->state)?-1:+1;
+        this->cpOld += 2*sign*p.values[k];
     }
+}
 
+bool CorrelationPointCore::affects(unsigned id) const
+{
+    return this->plan->offsets[id+1] > this->plan->offsets[id];
+}
 
-    if (_debug){
-        long res = this->getFullTotal(sys);
-        if (res!=this->cpOld) 
-            cerr<<"# (dbg CorrelationPointCore) total value is different: iterative="<<this->cpOld<<", full="<<res<<endl;
-    }
+double CorrelationPointCore::mismatch() const
+{
+    const long res = this->getFullTotal(this->sys);
+    return fabs(double(res - this->cpOld)) / std::max(1., fabs(double(res)));
+}
+
+double CorrelationPointCore::value() const
+{
+    return double(this->cpOld)/this->pointCount();
+}
+
+void CorrelationPointCore::update()
+{
+    this->cpOld = this->getFullTotal(this->sys);
+}
+
+double CorrelationPointCore::iterateCost() const
+{
+    // only the spins with neighbours are iterated
+    return (this->plan->interactingSpins + this->plan->correlationPairsNum * 2.) / this->sys->size();
+}
+
+double CorrelationPointCore::updateCost() const
+{
+    return this->sys->size() + this->plan->correlationPairsNum * 2.;
 }
 
 void CorrelationPointCore::incrementTotal(){
-    double addVal = double(this->cpOld)/this->pointCount();
+    double addVal = this->value();
     this->cp += addVal;
+    this->_binning.add(addVal);
     this->cp2 += addVal*addVal;
     if (this->_binder)
         this->cp4 += addVal*addVal*addVal*addVal;
 
     if (this->_histogramEnabled){
-        int i=0;
-        for (auto cps: this->correlationPointSpins){
+        for (auto & pairs: this->plan->pointPairs){
             int cpVal = 0;
-            for (auto partA: cps){
-                for (auto partB: this->correlationNeighboursByPoint[i][partA->Id()]){
-                    cpVal += this->method(partA,partB);
-                }
+            for (auto & pair: pairs){
+                cpVal += ((this->sys->parts[pair.a]->state ^ this->sys->parts[pair.b]->state)?-1:+1) * pair.value;
             }
             this->dos[cpVal]++;
-            ++i;
         }
     }
 }
 
 long CorrelationPointCore::getFullTotal(const PartArray * _sys) const
 {
+    const Plan & p = *this->plan;
     long res = 0;
-    for (auto partA : _sys->parts){
-            for (auto partB : this->correlationNeighbours[partA->Id()]){
-                res += this->method(partA,partB);
-            }
+    for (unsigned i=0; i<_sys->size(); ++i){
+        const bool stateA = _sys->parts[i]->state;
+        for (unsigned k=p.offsets[i]; k<p.offsets[i+1]; ++k){
+            res += ((stateA ^ _sys->parts[p.neighbours[k]]->state)?-1:+1) * p.values[k];
+        }
     }
     return res/2;
 }
@@ -236,17 +263,12 @@ long CorrelationPointCore::getFullTotal(const PartArray * _sys) const
 unsigned CorrelationPointCore::spinsInvolvedCount() const
 {
     unsigned res = 0;
-    for (auto cps: this->correlationPointSpins){
-        res += std::distance(cps.begin(), cps.end());
+    for (auto & cps: this->plan->pointSpins){
+        res += cps.size();
     }
     return res;
 }
 
-short CorrelationPointCore::method(const Part* partA, const Part* partB) const
-{
-    return ((partA->state ^ partB->state)?-1:+1) * this->correlationValues.at(std::make_pair(partA->Id(),partB->Id()));
-}
-
 void CorrelationPointCore::save(unsigned num){
     if (this->_histogramEnabled && !this->_histogramFilename.empty()){
         std::string fname = _histogramFilename;
@@ -4,6 +4,7 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>
 #include <gmpxx.h>
 #include "PartArray.h"
 #include "CalculationParameter.h"
@@ -13,12 +14,29 @@ class CorrelationPointCore: public CalculationParameter
 {
 
 public:
-    std::vector< std::forward_list < Part* > > correlationPointSpins;
-    std::vector< std::forward_list < Part* > > correlationNeighbours;
-    std::vector< std::vector< std::forward_list < Part* > > > correlationNeighboursByPoint; //fills only when histogram enabled
-    std::map< std::pair<unsigned, unsigned>, short > correlationValues;
-    unsigned correlationPairsNum;
-    float spinsInPoint;
+    // directed pair of spins inside a point, with its sign in the initial state
+    struct Pair {
+        unsigned a;
+        unsigned b;
+        signed char value;
+    };
+
+    /**
+     * @brief Spins of the points and their pairs. They depend only on the geometry and the initial state,
+     * so the plan is built once by the prototype and shared read-only by the copies of all chains.
+     */
+    struct Plan {
+        std::vector< std::vector<unsigned> > pointSpins;
+        std::vector< std::vector<Pair> > pointPairs; // for the histogram of every point
+        // neighbours of spin i in all its points are in [offsets[i],offsets[i+1])
+        std::vector<unsigned> offsets;
+        std::vector<unsigned> neighbours;
+        std::vector<signed char> values;
+        unsigned correlationPairsNum;
+        unsigned interactingSpins;
+        float spinsInPoint;
+        unsigned maxSpinsInPoint;
+    };
 
     CorrelationPointCore(
         const std::string & parameterId,
@@ -30,9 +48,16 @@ public:
     virtual bool check(unsigned N) const;
     virtual void printHeader(unsigned) const;
     virtual bool init(PartArray * sys);
+    virtual void rebuild() { this->buildPlan(); }
 
     virtual void iterate(unsigned id);
+    virtual bool affects(unsigned id) const;
     virtual void incrementTotal();
+    virtual double value() const;
+    virtual void update();
+    virtual double mismatch() const;
+    virtual double iterateCost() const;
+    virtual double updateCost() const;
     virtual mpf_class getTotal(unsigned steps){ return this->cp / steps; }
     virtual mpf_class getTotal2(unsigned steps){ return this->cp2 / steps; }
     virtual mpf_class getTotal4(unsigned steps){ return this->cp4 / steps; }
@@ -48,16 +73,16 @@ public:
 
 private:
 
+    void buildPlan();
     long getFullTotal(const PartArray * _sys) const;
     unsigned pointCount() const {return X.size();}
     //calculate how much spins involved in correlation points
     unsigned spinsInvolvedCount() const; 
 
-    short method(const Part* partA, const Part* partB) const;
-
     double _minRange;
     double _maxRange;
     double _distance;
+    std::shared_ptr<const Plan> plan;
     long cpOld;
     mpf_class cp;
     mpf_class cp2;
@@ -0,0 +1,436 @@
+#include "DomainDecomposition.h"
+
+#include <cmath>
+#include <chrono>
+#include <climits>
+#include <stdexcept>
+#include <algorithm>
+#include "BinningAnalysis.h"
+#include "misc.h"
+
+// uniform grid on XY plane with cell size equal to the interaction range over the given spins
+class HaloGrid
+{
+public:
+    HaloGrid(const PartArray & sys, const std::vector<unsigned> & spins, double cell): cell(cell)
+    {
+        minX = minY = INFINITY;
+        double maxX = -INFINITY, maxY = -INFINITY;
+        for (unsigned i : spins){
+            minX = std::min(minX, sys.parts[i]->pos.x); maxX = std::max(maxX, sys.parts[i]->pos.x);
+            minY = std::min(minY, sys.parts[i]->pos.y); maxY = std::max(maxY, sys.parts[i]->pos.y);
+        }
+        nx = spins.empty() ? 0 : long((maxX - minX) / cell) + 1;
+        ny = spins.empty() ? 0 : long((maxY - minY) / cell) + 1;
+        cells.resize(nx * ny);
+        for (unsigned k = 0; k < spins.size(); ++k){
+            const Vect & pos = sys.parts[spins[k]]->pos;
+            cells[long((pos.x - minX) / cell) + nx * long((pos.y - minY) / cell)].push_back(k);
+        }
+    }
+
+    // call f(k) for every spin k of the grid which may be within the cell size of pos
+    template<class F> void forNeighbours(const Vect & pos, F f) const
+    {
+        const long x0 = std::max(0l, long(floor((pos.x - cell - minX) / cell)));
+        const long x1 = std::min(nx - 1, long(floor((pos.x + cell - minX) / cell)));
+        const long y0 = std::max(0l, long(floor((pos.y - cell - minY) / cell)));
+        const long y1 = std::min(ny - 1, long(floor((pos.y + cell - minY) / cell)));
+        for (long y = y0; y <= y1; ++y)
+            for (long x = x0; x <= x1; ++x)
+                for (unsigned k : cells[x + nx * y])
+                    f(k);
+    }
+
+private:
+    double cell, minX, minY;
+    long nx, ny;
+    std::vector< std::vector<unsigned> > cells;
+};
+
+// spin sent from the root rank to the ranks which own it or keep it in the halo
+struct DomainSpin
+{
+    unsigned id;
+    double pos[3];
+    double m[3];
+};
+
+DomainDecomposition::DomainDecomposition(const PartArray & sys, double range, bool pbc, const Vect & field, MpiCoordinator & coordinator):
+coordinator(coordinator)
+{
+    const int R = coordinator.size();
+    const int rank = coordinator.rank();
+
+    // slabs with about equal number of spins, the bounds are quantiles of x of a sample taken on the root rank
+    std::vector<double> limits; // bounds, then minimal and maximal x
+    if (coordinator.isRoot()){
+        const unsigned N = sys.size();
+        std::vector<double> xs;
+        double minX = INFINITY, maxX = -INFINITY;
+        for (unsigned i = 0; i < N; ++i){
+            minX = std::min(minX, sys.parts[i]->pos.x);
+            maxX = std::max(maxX, sys.parts[i]->pos.x);
+        }
+        if (uint64_t(N) <= uint64_t(R) * DOMAIN_SAMPLE_PER_RANK){
+            for (unsigned i = 0; i < N; ++i)
+                xs.push_back(sys.parts[i]->pos.x);
+        } else {
+            default_random_engine generator;
+            uniform_int_distribution<unsigned> intDistr(0, N - 1);
+            for (unsigned n = 0; n < unsigned(R) * DOMAIN_SAMPLE_PER_RANK; ++n)
+                xs.push_back(sys.parts[intDistr(generator)]->pos.x);
+        }
+        std::sort(xs.begin(), xs.end());
+        for (int r = 1; r < R; ++r)
+            limits.push_back(xs[uint64_t(r) * xs.size() / R]);
+        limits.push_back(minX);
+        limits.push_back(maxX);
+    }
+    coordinator.broadcast(limits, 0);
+    const double minX = limits[R - 1], maxX = limits[R];
+    this->bounds.assign(limits.begin(), limits.begin() + R - 1);
+
+    auto slabLo = [&](int r){ return (r == 0) ? minX : this->bounds[r - 1]; };
+    auto slabHi = [&](int r){ return (r == R - 1) ? maxX : this->bounds[r]; };
+    for (int r = 0; r < R; ++r){
+        if (R > 1 && slabHi(r) - slabLo(r) < 2 * range)
+            throw(std::invalid_argument("Subdomains are narrower than two interaction ranges, use less MPI ranks"));
+    }
+    const double middle = (slabLo(rank) + slabHi(rank)) / 2;
+
+    // distance along x from the slab r, the halo spins are closer than range
+    auto slabDistance = [&](double x, int r)
+    {
+        const double lo = slabLo(r), hi = slabHi(r);
+        double d = std::max({lo - x, x - hi, 0.});
+        if (pbc){
+            const double sx = ConfigManager::size.x;
+            d = std::min({d, std::max({lo - x - sx, x + sx - hi, 0.}), std::max({lo - x + sx, x - sx - hi, 0.})});
+        }
+        return d;
+    };
+
+    // the root rank sends to every rank its own spins in the order of numbers, then the candidates to its halo.
+    // Slabs are wider than two ranges, so only the neighbouring slabs (and the edge slabs with PBC) are candidates
+    std::vector<char> received;
+    {
+        std::vector<std::vector<char>> parts(coordinator.isRoot() ? R : 0);
+        auto append = [&](int r, unsigned i){
+            const Part * part = sys.parts[i];
+            const DomainSpin spin = {i, {part->pos.x, part->pos.y, part->pos.z}, {part->m.x, part->m.y, part->m.z}};
+            const char * bytes = reinterpret_cast<const char *>(&spin);
+            parts[r].insert(parts[r].end(), bytes, bytes + sizeof(DomainSpin));
+        };
+        const unsigned N = coordinator.isRoot() ? sys.size() : 0;
+        for (unsigned i = 0; i < N; ++i)
+            append(this->owner(sys.parts[i]->pos.x), i);
+        for (unsigned i = 0; i < N; ++i){
+            const int o = this->owner(sys.parts[i]->pos.x);
+            int candidates[4] = {o - 1, o + 1, pbc ? 0 : -1, pbc ? R - 1 : -1};
+            std::sort(candidates, candidates + 4);
+            for (int c = 0; c < 4; ++c){
+                const int r = candidates[c];
+                if (r >= 0 && r < R && r != o && (c == 0 || r != candidates[c - 1]) && slabDistance(sys.parts[i]->pos.x, r) < range)
+                    append(r, i);
+            }
+        }
+        coordinator.scatter(parts, received);
+    }
+
+    // own spins first, then the candidates to the halo
+    PartArray slab;
+    std::vector<unsigned> ids;
+    this->owned = 0;
+    for (size_t offset = 0; offset < received.size(); offset += sizeof(DomainSpin)){
+        DomainSpin spin;
+        std::copy(received.begin() + offset, received.begin() + offset + sizeof(DomainSpin), reinterpret_cast<char *>(&spin));
+        Part * part = new Part();
+        part->pos.setXYZ(spin.pos[0], spin.pos[1], spin.pos[2]);
+        part->m.setXYZ(spin.m[0], spin.m[1], spin.m[2]);
+        slab.add(part);
+        ids.push_back(spin.id);
+        if (this->owner(spin.pos[0]) == rank)
+            ++this->owned;
+    }
+    std::vector<unsigned> nearby(ids.size());
+    for (unsigned k = 0; k < ids.size(); ++k)
+        nearby[k] = k;
+
+    std::vector<Vect> images(1, Vect(0, 0, 0));
+    if (pbc){
+        for (double ix : {-1., 0., 1.})
+            for (double iy : {-1., 0., 1.})
+                if ((ix != 0 && ConfigManager::size.x > 0) || (iy != 0 && ConfigManager::size.y > 0))
+                    images.push_back(Vect(ix * ConfigManager::size.x, iy * ConfigManager::size.y, 0));
+    }
+
+    double (*hamiltonian)(Part*, Part*) = pbc ? hamiltonianDipolarPBC : hamiltonianDipolar;
+
+    // neighbours within range, as numbers in slab
+    HaloGrid grid(slab, nearby, range);
+    std::vector<unsigned> mark(ids.size(), UINT_MAX);
+    std::vector<bool> used(ids.size(), false);
+    this->offsets.push_back(0);
+    for (unsigned k = 0; k < this->owned; ++k){
+        Part * partA = slab.parts[k];
+        mark[k] = k;
+        for (const Vect & image : images){
+            grid.forNeighbours(partA->pos + image, [&](unsigned l){
+                if (mark[l] == k) return;
+                mark[l] = k;
+                Part * partB = slab.parts[l];
+                const double r = pbc ? radiusPBC(partA->pos, partB->pos).length() : partA->pos.space(partB->pos);
+                if (r < range){
+                    this->neighbours.push_back(l);
+                    this->energies.push_back(hamiltonian(partA, partB));
+                    used[l] = true;
+                }
+            });
+        }
+        this->offsets.push_back(this->neighbours.size());
+        this->fieldEnergies.push_back(partA->m.scalar(field));
+        this->moments.push_back(partA->m);
+        this->colours[partA->pos.x < middle ? 0 : 1].push_back(k);
+    }
+
+    // halo spins are sorted by rank and number, so every pair of ranks has the same order of the exchanged spins
+    std::vector<unsigned> halo;
+    for (unsigned l = this->owned; l < ids.size(); ++l){
+        if (used[l])
+            halo.push_back(l);
+    }
+    std::sort(halo.begin(), halo.end(), [&](unsigned a, unsigned b){
+        const int ra = this->owner(slab.parts[a]->pos.x), rb = this->owner(slab.parts[b]->pos.x);
+        return (ra != rb) ? ra < rb : ids[a] < ids[b];
+    });
+
+    std::vector<unsigned> local(ids.size());
+    std::vector<int> haloOwner(halo.size());
+    this->global.assign(ids.begin(), ids.begin() + this->owned);
+    for (unsigned k = 0; k < this->owned; ++k)
+        local[k] = k;
+    for (unsigned h = 0; h < halo.size(); ++h){
+        local[halo[h]] = this->owned + h;
+        this->global.push_back(ids[halo[h]]);
+        haloOwner[h] = this->owner(slab.parts[halo[h]]->pos.x);
+        if (this->haloRanks.empty() || this->haloRanks.back() != haloOwner[h]){
+            this->haloRanks.push_back(haloOwner[h]);
+            this->recvSpins.emplace_back();
+            this->sendSpins.emplace_back();
+        }
+        this->recvSpins.back().push_back(this->owned + h);
+    }
+    for (unsigned & l : this->neighbours)
+        l = local[l];
+
+    // interaction is symmetric, so the rank needs the own spins which have neighbours of that rank
+    for (unsigned k = 0; k < this->owned; ++k){
+        for (unsigned b = this->offsets[k]; b < this->offsets[k + 1]; ++b){
+            const unsigned l = this->neighbours[b];
+            if (l < this->owned)
+                continue;
+            const unsigned q = std::lower_bound(this->haloRanks.begin(), this->haloRanks.end(), haloOwner[l - this->owned]) - this->haloRanks.begin();
+            if (this->sendSpins[q].empty() || this->sendSpins[q].back() != k)
+                this->sendSpins[q].push_back(k);
+        }
+    }
+    this->sendBuffers.resize(this->haloRanks.size());
+    this->recvBuffers.resize(this->haloRanks.size());
+    for (unsigned q = 0; q < this->haloRanks.size(); ++q){
+        this->sendBuffers[q].resize(this->sendSpins[q].size());
+        this->recvBuffers[q].resize(this->recvSpins[q].size());
+    }
+
+    this->reset();
+}
+
+int DomainDecomposition::owner(double x) const
+{
+    return std::upper_bound(this->bounds.begin(), this->bounds.end(), x) - this->bounds.begin();
+}
+
+void DomainDecomposition::reset()
+{
+    this->spins.assign(this->global.size(), 1);
+    this->refresh();
+}
+
+void DomainDecomposition::refresh()
+{
+    // bonds between own spins are counted twice, bonds to the halo spins are shared with the other rank
+    this->eShare = 0;
+    this->mShare = Vect(0, 0, 0);
+    for (unsigned i = 0; i < this->owned; ++i){
+        double local = 0;
+        for (unsigned b = this->offsets[i]; b < this->offsets[i + 1]; ++b)
+            local += this->energies[b] * this->spins[this->neighbours[b]];
+        this->eShare += this->spins[i] * (local / 2 - this->fieldEnergies[i]);
+        this->mShare += this->moments[i] * this->spins[i];
+    }
+}
+
+void DomainDecomposition::sweep(double t, default_random_engine & generator)
+{
+    uniform_real_distribution<double> doubleDistr(0, 1); // right edge is not included
+
+    for (unsigned c = 0; c < 2; ++c){
+        const std::vector<unsigned> & colour = this->colours[c];
+        if (!colour.empty()){
+            uniform_int_distribution<unsigned> intDistr(0, colour.size() - 1); // including right edge
+            for (unsigned n = 0; n < colour.size(); ++n){
+                const unsigned i = colour[intDistr(generator)];
+                double local = 0;
+                for (unsigned b = this->offsets[i]; b < this->offsets[i + 1]; ++b)
+                    local += this->energies[b] * this->spins[this->neighbours[b]];
+                const double dE = -2. * this->spins[i] * (local - this->fieldEnergies[i]);
+                if (dE < 0 || (t > 0 && doubleDistr(generator) <= exp(-dE / t))){
+                    this->spins[i] = -this->spins[i];
+                    // the whole change of the system energy, the neighbouring rank does not see it
+                    this->eShare += dE;
+                    this->mShare += this->moments[i] * (2. * this->spins[i]);
+                }
+            }
+        }
+        this->exchangeHalo();
+    }
+}
+
+void DomainDecomposition::exchangeHalo()
+{
+    for (unsigned q = 0; q < this->haloRanks.size(); ++q){
+        for (unsigned n = 0; n < this->sendSpins[q].size(); ++n)
+            this->sendBuffers[q][n] = this->spins[this->sendSpins[q][n]];
+    }
+    this->coordinator.exchange(this->haloRanks, this->sendBuffers, this->recvBuffers);
+    for (unsigned q = 0; q < this->haloRanks.size(); ++q){
+        for (unsigned n = 0; n < this->recvSpins[q].size(); ++n)
+            this->spins[this->recvSpins[q][n]] = this->recvBuffers[q][n];
+    }
+}
+
+void DomainDecomposition::measure(double & e, Vect & m)
+{
+    std::vector<double> values = {this->eShare, this->mShare.x, this->mShare.y, this->mShare.z};
+    this->coordinator.sumAll(values);
+    e = values[0];
+    m = Vect(values[1], values[2], values[3]);
+}
+
+void DomainDecomposition::storeState()
+{
+    this->stored.assign(this->spins.begin(), this->spins.begin() + this->owned);
+}
+
+void DomainDecomposition::gatherState(PartArray & sys)
+{
+    std::vector<char> local(this->stored.begin(), this->stored.end()), all;
+    this->coordinator.gather(local, all);
+    if (!this->coordinator.isRoot())
+        return;
+
+    // the own spins of every rank are in the order of their numbers
+    std::vector<unsigned> position(this->bounds.size() + 1, 0);
+    for (unsigned i = 0; i < sys.size(); ++i)
+        ++position[this->owner(sys.parts[i]->pos.x)];
+    unsigned offset = 0;
+    for (unsigned & p : position){
+        const unsigned count = p;
+        p = offset;
+        offset += count;
+    }
+    for (unsigned i = 0; i < sys.size(); ++i){
+        const bool rotated = all[position[this->owner(sys.parts[i]->pos.x)]++] < 0;
+        if (sys.parts[i]->state != rotated)
+            sys.parts[i]->rotate(false);
+    }
+}
+
+double domainMonteCarlo(ConfigManager & config, MpiCoordinator & coordinator, std::string & lowestState)
+{
+    const unsigned N = config.N();
+    const unsigned measureEvery = config.getMeasureEvery();
+
+    DomainDecomposition domain(config.getSystem(), config.getRange(), config.isPBC(), config.getField(), coordinator);
+
+    { // balance of the subdomains
+        std::vector<int> sizes = {int(domain.ownedCount()), -int(domain.ownedCount()), int(domain.haloCount()), -int(domain.haloCount())};
+        coordinator.maxAll(sizes);
+        if (coordinator.isRoot()){
+            printf("# subdomains: %d to %d spins, %d to %d halo spins per rank\n", -sizes[1], sizes[0], -sizes[3], sizes[2]);
+            fflush(stdout);
+        }
+    }
+
+    double eLowest = INFINITY;
+
+    for (unsigned tt = 0; tt < config.temperatures.size(); ++tt){
+        auto time_start = std::chrono::steady_clock::now();
+        const double t = config.temperatures[tt];
+
+        default_random_engine generator;
+        generator.seed(config.getSeed() + tt + coordinator.rank() * REPLICA_SEED_STRIDE);
+        domain.reset();
+
+        for (unsigned step = 0; step < config.getHeatup(); ++step){
+            domain.sweep(t, generator);
+            if ((step + 1) % FULL_REFRESH_EVERY == 0)
+                domain.refresh();
+        }
+
+        double e = 0, e2 = 0, e4 = 0, m = 0, m2 = 0, m4 = 0;
+        BinningAnalysis eBinning, mBinning;
+        unsigned measured = 0;
+        for (unsigned step = 0; step < config.getCalculate(); ++step){
+            domain.sweep(t, generator);
+            if ((step + 1) % FULL_REFRESH_EVERY == 0)
+                domain.refresh();
+            if ((step + 1) % measureEvery != 0)
+                continue;
+
+            double eNow;
+            Vect mNow;
+            domain.measure(eNow, mNow);
+            const double mLength = mNow.length();
+            e += eNow; e2 += eNow * eNow; e4 += eNow * eNow * eNow * eNow;
+            m += mLength; m2 += mLength * mLength; m4 += mLength * mLength * mLength * mLength;
+            eBinning.add(eNow);
+            mBinning.add(mLength);
+            if (eNow < eLowest){
+                eLowest = eNow;
+                domain.storeState();
+            }
+            ++measured;
+        }
+        if (measured > 0){
+            e /= measured; e2 /= measured; e4 /= measured;
+            m /= measured; m2 /= measured; m4 /= measured;
+        }
+        const double cT = (e2 - e * e) / (t * t * N);
+
+        auto time_end = std::chrono::steady_clock::now();
+        auto rtime = std::chrono::duration_cast<std::chrono::milliseconds>(time_end - time_start).count();
+
+        if (coordinator.isRoot()){
+            printf("%e %.15e %.15e %.15e", t, cT, e, e2);
+            if (config.isBinder())
+                printf(" %.15e", e4);
+            printf(" %d %d %.15e %.15e", coordinator.size(), config.getSeed() + tt, m, m2);
+            if (config.isBinder())
+                printf(" %.15e", m4);
+            printf(" %f", rtime / 1000.);
+            printf(" %e %e %e %e %e\n",
+                eBinning.varianceError() / (t * t * N), eBinning.meanError(), eBinning.tau(),
+                mBinning.meanError(), mBinning.tau());
+            fflush(stdout);
+        }
+    }
+
+    if (!std::isinf(eLowest)){
+        PartArray sys = coordinator.isRoot() ? config.getSystem() : PartArray();
+        domain.gatherState(sys);
+        if (coordinator.isRoot())
+            lowestState = sys.state.toString();
+    }
+    return eLowest;
+}
@@ -0,0 +1,89 @@
+#ifndef DOMAINDECOMPOSITION_H
+#define DOMAINDECOMPOSITION_H
+
+#include <vector>
+#include <string>
+#include <random>
+#include "PartArray.h"
+#include "ConfigManager.h"
+#include "MpiCoordinator.h"
+
+/**
+ * @brief Metropolis of a single system split over MPI ranks.
+ * The system is cut along x into slabs with about equal number of spins, one slab per rank.
+ * The system is loaded on the root rank only, it sends to every rank the spins of its slab and halo.
+ * Every slab is split into two halves (colours), and all ranks update the spins of the same colour at once.
+ * The halves of one colour are separated by at least the interaction range, so the simultaneous flips
+ * do not interact, and the states of the boundary spins (halo) are exchanged after every colour phase.
+ * A rank keeps the neighbours and bond energies of its own spins only.
+ * Energy and magnetisation are tracked for the own spins and reduced over all ranks on measurement.
+ */
+class DomainDecomposition
+{
+public:
+    // collective: sys is used on the root rank only, throws if the slabs are narrower than two interaction ranges
+    DomainDecomposition(const PartArray & sys, double range, bool pbc, const Vect & field, MpiCoordinator & coordinator);
+
+    // set all spins to the initial state of the system
+    void reset();
+
+    // collective: one MC step, N trials over all ranks
+    void sweep(double t, default_random_engine & generator);
+
+    // full recalculation of the energy, to avoid FP error collection
+    void refresh();
+
+    // collective: energy and magnetisation of the whole system
+    void measure(double & e, Vect & m);
+
+    // keep the current state of the own spins
+    void storeState();
+
+    // collective: the stored states of all ranks are applied to sys on the root rank
+    void gatherState(PartArray & sys);
+
+    unsigned ownedCount() const { return this->owned; }
+    unsigned haloCount() const { return this->global.size() - this->owned; }
+
+private:
+    int owner(double x) const;
+    void exchangeHalo();
+
+    MpiCoordinator & coordinator;
+    std::vector<double> bounds; // slab r is [bounds[r-1], bounds[r]) along x
+
+    // own spins are first, then the halo spins sorted by their ranks
+    unsigned owned;
+    std::vector<unsigned> global;       // number of the spin in the system
+    std::vector<signed char> spins;     // +1 is the initial state, -1 is rotated
+    std::vector<signed char> stored;
+    std::vector<unsigned> colours[2];
+
+    // neighbours of own spin i are in [offsets[i],offsets[i+1]), energies are for the initial states
+    std::vector<unsigned> offsets;
+    std::vector<unsigned> neighbours;
+    std::vector<double> energies;
+    std::vector<double> fieldEnergies; // m.field of the initial state
+    std::vector<Vect> moments;
+
+    // spins sent to and received from the neighbouring ranks
+    std::vector<int> haloRanks;
+    std::vector<std::vector<unsigned>> sendSpins;
+    std::vector<std::vector<unsigned>> recvSpins;
+    std::vector<std::vector<char>> sendBuffers;
+    std::vector<std::vector<char>> recvBuffers;
+
+    // part of the system energy and magnetisation, the sum over ranks is the total
+    double eShare;
+    Vect mShare;
+};
+
+/**
+ * @brief Metropolis for all temperatures with the system split over MPI ranks, see DomainDecomposition.
+ * Temperatures are calculated one after another by all ranks, the root rank prints the results.
+ *
+ * @return the lowest measured energy, its state is written to lowestState on the root rank
+ */
+double domainMonteCarlo(ConfigManager & config, MpiCoordinator & coordinator, std::string & lowestState);
+
+#endif //DOMAINDECOMPOSITION_H
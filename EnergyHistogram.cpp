@@ -0,0 +1,109 @@
+#include "EnergyHistogram.h"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+EnergyHistogram::EnergyHistogram(double width, double t, unsigned N, const std::vector<std::string> & parameterIds):
+_width(width),
+t(t),
+_N(N),
+_samples(0),
+_parameterIds(parameterIds)
+{
+}
+
+void EnergyHistogram::add(double e, const std::vector<double> & values)
+{
+    bin & b = this->_bins[lround(e / this->_width)];
+    if (b.count == 0){
+        b.sum.assign(this->_parameterIds.size(), 0);
+        b.sumAbs.assign(this->_parameterIds.size(), 0);
+        b.sum2.assign(this->_parameterIds.size(), 0);
+    }
+    b.count += 1;
+    b.sumE += e;
+    for (unsigned i = 0; i < this->_parameterIds.size(); ++i){
+        b.sum[i] += values[i];
+        b.sumAbs[i] += fabs(values[i]);
+        b.sum2[i] += values[i] * values[i];
+    }
+    this->_samples += 1;
+}
+
+void EnergyHistogram::save(const std::string & filename) const
+{
+    std::ofstream f(filename);
+    f << std::setprecision(15);
+    f << "# energy histogram" << std::endl;
+    f << "# T = " << this->t << std::endl;
+    f << "# N = " << this->_N << std::endl;
+    f << "# width = " << this->_width << std::endl;
+    f << "# samples = " << this->_samples << std::endl;
+    f << "# parameters =";
+    for (auto & id : this->_parameterIds)
+        f << " " << id;
+    f << std::endl;
+    f << "# columns: <E> count, then sum(p) sum(|p|) sum(p^2) of every parameter" << std::endl;
+    for (auto & it : this->_bins){
+        const bin & b = it.second;
+        f << b.sumE / b.count << " " << b.count;
+        for (unsigned i = 0; i < this->_parameterIds.size(); ++i)
+            f << " " << b.sum[i] << " " << b.sumAbs[i] << " " << b.sum2[i];
+        f << std::endl;
+    }
+}
+
+void EnergyHistogram::load(const std::string & filename)
+{
+    std::ifstream f(filename);
+    if (!f.is_open())
+        throw std::invalid_argument("Can not open histogram file " + filename);
+
+    this->_bins.clear();
+    this->_parameterIds.clear();
+    this->_samples = 0;
+    this->_width = 0;
+    bool parametersRead = false;
+
+    std::string line;
+    while (std::getline(f, line)){
+        if (line.empty())
+            continue;
+        if (line[0] == '#'){
+            std::istringstream ss(line.substr(1));
+            std::string key, eq;
+            ss >> key >> eq;
+            if (eq != "=") continue;
+            if (key == "T") ss >> this->t;
+            if (key == "N") ss >> this->_N;
+            if (key == "width") ss >> this->_width;
+            if (key == "parameters"){
+                std::string id;
+                while (ss >> id)
+                    this->_parameterIds.push_back(id);
+                parametersRead = true;
+            }
+            continue;
+        }
+
+        if (this->_width <= 0 || this->_N == 0 || !parametersRead)
+            throw std::invalid_argument("File " + filename + " is not the energy histogram, the header is missing");
+
+        std::istringstream ss(line);
+        bin b;
+        double e;
+        ss >> e >> b.count;
+        b.sumE = e * b.count;
+        const unsigned P = this->_parameterIds.size();
+        b.sum.resize(P); b.sumAbs.resize(P); b.sum2.resize(P);
+        for (unsigned i = 0; i < P; ++i)
+            ss >> b.sum[i] >> b.sumAbs[i] >> b.sum2[i];
+        if (ss.fail())
+            throw std::invalid_argument("Wrong line in histogram file " + filename + ": " + line);
+        this->_bins[lround(e / this->_width)] = b;
+        this->_samples += b.count;
+    }
+}
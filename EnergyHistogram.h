@@ -0,0 +1,49 @@
+#ifndef ENERGYHISTOGRAM_H
+#define ENERGYHISTOGRAM_H
+
+#include <map>
+#include <vector>
+#include <string>
+
+/**
+ * @brief Histogram of energy measured at a temperature, with bins of the fixed width.
+ * Every bin keeps also the sums of parameter values measured in this bin (joint energy/parameter histogram),
+ * which is enough to reweight the parameters to other temperatures.
+ */
+class EnergyHistogram
+{
+public:
+    struct bin {
+        double count;
+        double sumE;
+        std::vector<double> sum;
+        std::vector<double> sumAbs;
+        std::vector<double> sum2;
+    };
+
+    EnergyHistogram(double width = 1, double t = 0, unsigned N = 0,
+        const std::vector<std::string> & parameterIds = std::vector<std::string>());
+
+    void add(double e, const std::vector<double> & values);
+
+    void save(const std::string & filename) const;
+    // throws std::invalid_argument if the file is not the energy histogram
+    void load(const std::string & filename);
+
+    const std::map<long, bin> & bins() const { return this->_bins; }
+    double width() const { return this->_width; }
+    double temperature() const { return this->t; }
+    unsigned N() const { return this->_N; }
+    double samples() const { return this->_samples; }
+    const std::vector<std::string> & parameterIds() const { return this->_parameterIds; }
+
+private:
+    std::map<long, bin> _bins;
+    double _width;
+    double t;
+    unsigned _N;
+    double _samples;
+    std::vector<std::string> _parameterIds;
+};
+
+#endif //ENERGYHISTOGRAM_H
@@ -0,0 +1,47 @@
+#ifndef ENERGYRECORD_H
+#define ENERGYRECORD_H
+
+#include <atomic>
+
+/**
+ * @brief The lowest energy found by concurrent chains.
+ * The record is lowered by compare-and-swap, so the chains read it without locks,
+ * and only the chain which really lowers the record goes on to capture its state.
+ */
+class EnergyRecord
+{
+public:
+    // energies should be lower than threshold to become the record
+    explicit EnergyRecord(double threshold): best(threshold) {}
+
+    // true if e is the new record
+    bool improve(double e)
+    {
+        double current = this->best.load(std::memory_order_relaxed);
+        while (e < current){
+            if (this->best.compare_exchange_weak(current, e, std::memory_order_acq_rel, std::memory_order_relaxed))
+                return true;
+        }
+        return false;
+    }
+
+    double value() const { return this->best.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<double> best;
+};
+
+/**
+ * @brief The flag to stop all the chains, cheap enough to check every MC step.
+ */
+class CancellationToken
+{
+public:
+    void cancel() { this->cancelled.store(true, std::memory_order_release); }
+    bool isCancelled() const { return this->cancelled.load(std::memory_order_acquire); }
+
+private:
+    std::atomic<bool> cancelled{false};
+};
+
+#endif //ENERGYRECORD_H
@@ -0,0 +1,56 @@
+#include "EquilibrationDetector.h"
+
+#include <cmath>
+#include "defines.h"
+
+EquilibrationDetector::EquilibrationDetector(unsigned seriesCount, unsigned window):
+_window(window),
+previous(seriesCount),
+current(seriesCount)
+{
+}
+
+bool EquilibrationDetector::add(const std::vector<double> & values)
+{
+    for (unsigned i = 0; i < this->current.size(); ++i)
+        this->current[i].add(values[i]);
+
+    if (this->current[0].count() < this->_window)
+        return false;
+
+    for (auto & c : this->current){
+        if (c.tau() * HEATUP_WINDOW_TAUS > this->_window || !c.converged()){
+            // window is too short comparing to the autocorrelation time, or too short to measure it
+            this->_window *= 2;
+            // the series since the start contains the relaxation, which looks like the long correlation
+            for (auto & p : this->previous)
+                p.clear();
+            for (auto & s : this->current)
+                s.clear();
+            return false;
+        }
+    }
+
+    bool res = this->stationary();
+
+    this->previous.swap(this->current);
+    for (auto & c : this->current)
+        c.clear();
+
+    return res;
+}
+
+bool EquilibrationDetector::stationary() const
+{
+    for (unsigned i = 0; i < this->current.size(); ++i){
+        const BinningAnalysis & p = this->previous[i];
+        const BinningAnalysis & c = this->current[i];
+        if (p.count() == 0)
+            return false;
+
+        const double err = sqrt(p.meanError() * p.meanError() + c.meanError() * c.meanError());
+        if (fabs(c.mean() - p.mean()) > HEATUP_DRIFT_SIGMAS * err)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef EQUILIBRATIONDETECTOR_H
+#define EQUILIBRATIONDETECTOR_H
+
+#include <vector>
+#include "BinningAnalysis.h"
+
+/**
+ * @brief Detects the end of heatup by the drift test of block averages.
+ * The time series (energy and optionally parameters) are split into two adjacent windows.
+ * The series is stationary when the averages of both windows coincide within the binning errors.
+ * The window grows twice if it is shorter than HEATUP_WINDOW_TAUS autocorrelation times, or if the binning errors
+ * have no plateau yet, i.e. the autocorrelation time is longer than the window can measure,
+ * so slow relaxations are not taken as stationary.
+ */
+class EquilibrationDetector
+{
+public:
+    EquilibrationDetector(unsigned seriesCount, unsigned window);
+
+    /**
+     * @brief add values of all series after one MC step
+     * @return true if all series are stationary
+     */
+    bool add(const std::vector<double> & values);
+
+    unsigned window() const { return this->_window; }
+
+private:
+    bool stationary() const;
+
+    unsigned _window;
+    std::vector<BinningAnalysis> previous;
+    std::vector<BinningAnalysis> current;
+};
+
+#endif //EQUILIBRATIONDETECTOR_H
@@ -0,0 +1,161 @@
+#include "LoopUpdate.h"
+
+#include <cmath>
+#include "misc.h"
+
+LoopUpdate::LoopUpdate(PartArray & sys, double threshold):
+sys(sys),
+_attempts(0),
+_formed(0),
+_accepted(0),
+_flippedSpins(0)
+{
+    const unsigned N = sys.size();
+    strong.resize(N);
+    strongE.resize(N);
+    inPath.resize(N, 0);
+
+    sys.E(); // make sure the energy table is ready
+
+    for (unsigned i = 0; i < N; ++i){
+        std::vector<unsigned> ids;
+        std::vector<double> energies;
+        unsigned j = 0;
+        if (sys.interactionRange() != 0.0){
+            for (Part *neigh : sys.neighbours[i]){
+                ids.push_back(neigh->Id());
+                energies.push_back(sys.eAt(i, j));
+                ++j;
+            }
+        } else {
+            for (Part *neigh : sys.parts){
+                if (neigh != sys.parts[i]){
+                    ids.push_back(neigh->Id());
+                    energies.push_back(sys.eAt(i, j));
+                    ++j;
+                }
+            }
+        }
+
+        double maxE = 0;
+        for (double e : energies)
+            maxE = std::max(maxE, fabs(e));
+
+        for (unsigned k = 0; k < ids.size(); ++k){
+            if (maxE > 0 && fabs(energies[k]) >= threshold * maxE){
+                strong[i].push_back(ids[k]);
+                strongE[i].push_back(energies[k]);
+            }
+        }
+    }
+}
+
+unsigned LoopUpdate::candidates(unsigned i, int prev, std::vector<unsigned> * out) const
+{
+    unsigned res = 0;
+    if (out) out->clear();
+    const bool stateA = sys.parts[i]->state;
+    for (unsigned k = 0; k < strong[i].size(); ++k){
+        const unsigned j = strong[i][k];
+        if ((int)j == prev)
+            continue;
+        // current energy of the bond
+        const double e = (sys.parts[j]->state == stateA) ? strongE[i][k] : -strongE[i][k];
+        if (e < 0){
+            ++res;
+            if (out) out->push_back(j);
+        }
+    }
+    return res;
+}
+
+double LoopUpdate::logProposal() const
+{
+    // the loop may be built starting from any of its spins and in both directions
+    const unsigned m = path.size();
+    double res = -INFINITY;
+    for (int dir = -1; dir <= 1; dir += 2){
+        double logProd = 0;
+        double sumStarts = 0;
+        for (unsigned l = 0; l < m; ++l){
+            const unsigned pred = path[(l + m - dir) % m];
+            const unsigned a = candidates(path[l], pred, nullptr);
+            const unsigned b = candidates(path[l], -1, nullptr);
+            if (a == 0 || b == 0)
+                return -INFINITY;
+            logProd -= log(double(a));
+            sumStarts += double(a) / b;
+        }
+        const double logDir = logProd + log(sumStarts);
+        // log(exp(res)+exp(logDir))
+        const double hi = std::max(res, logDir), lo = std::min(res, logDir);
+        res = std::isinf(lo) ? hi : hi + log1p(exp(lo - hi));
+    }
+    return res;
+}
+
+bool LoopUpdate::attempt(double t, const Vect & field, std::default_random_engine & generator, double & dE)
+{
+    ++_attempts;
+    const unsigned N = sys.size();
+    std::uniform_int_distribution<unsigned> startDistr(0, N - 1);
+    std::uniform_real_distribution<double> doubleDistr(0, 1);
+
+    path.clear();
+    const unsigned s0 = startDistr(generator);
+    path.push_back(s0);
+    inPath[s0] = 1;
+
+    int prev = -1;
+    unsigned cur = s0;
+    bool closed = false;
+    while (true){
+        const unsigned count = candidates(cur, prev, &cand);
+        if (count == 0)
+            break;
+        const unsigned j = cand[std::uniform_int_distribution<unsigned>(0, count - 1)(generator)];
+        if (j == s0){
+            closed = true;
+            break;
+        }
+        if (inPath[j])
+            break;
+        path.push_back(j);
+        inPath[j] = 1;
+        prev = cur;
+        cur = j;
+    }
+
+    for (unsigned id : path)
+        inPath[id] = 0;
+
+    if (!closed)
+        return false;
+    ++_formed;
+
+    const double logForward = logProposal();
+
+    dE = 0;
+    for (unsigned id : path){
+        dE += deltaEnergy(sys, id, field);
+        sys.parts[id]->rotate(false);
+    }
+
+    const double logReverse = logProposal();
+
+    bool accept;
+    if (t == 0)
+        accept = (dE < 0 && logReverse >= logForward);
+    else
+        accept = doubleDistr(generator) <= exp(-dE / t + logReverse - logForward);
+
+    if (!accept){
+        for (unsigned id : path)
+            sys.parts[id]->rotate(false);
+        return false;
+    }
+
+    ++_accepted;
+    _flippedSpins += path.size();
+    return true;
+}
@@ -0,0 +1,54 @@
+#ifndef LOOPUPDATE_H
+#define LOOPUPDATE_H
+
+#include <vector>
+#include <random>
+#include "PartArray.h"
+
+/**
+ * @brief Non-local loop move for spin ice like systems.
+ * The loop is a closed path of spins, connected by the strong bonds (at least threshold*strongest bond of the spin)
+ * which are satisfied, i.e. have negative energy. In spin ice it is the head-to-tail chain of spins,
+ * so the flip of the whole loop keeps the ice rule on every vertex.
+ * Flip is accepted with Metropolis-Hastings probability, which takes into account
+ * the probabilities to build the same loop before and after the flip from any spin and in both directions.
+ */
+class LoopUpdate
+{
+public:
+    LoopUpdate(PartArray & sys, double threshold);
+
+    /**
+     * @brief build the loop from the random spin and try to flip it
+     * @param dE energy change of accepted flip
+     * @return true if the loop is flipped. Spins of the loop are in loop()
+     */
+    bool attempt(double t, const Vect & field, std::default_random_engine & generator, double & dE);
+
+    const std::vector<unsigned> & loop() const { return this->path; }
+
+    unsigned long attempts() const { return this->_attempts; }
+    unsigned long formed() const { return this->_formed; }
+    unsigned long accepted() const { return this->_accepted; }
+    unsigned long flippedSpins() const { return this->_flippedSpins; }
+
+private:
+    // number of satisfied strong bonds of spin i, except the bond to prev. Fills out if it is set
+    unsigned candidates(unsigned i, int prev, std::vector<unsigned> * out) const;
+    // logarithm of the probability to build the current path as a loop
+    double logProposal() const;
+
+    PartArray & sys;
+    std::vector< std::vector<unsigned> > strong; // ids of strong neighbours
+    std::vector< std::vector<double> > strongE; // energy of the bond when both spins are in the same state
+    std::vector<unsigned> path;
+    std::vector<char> inPath;
+    std::vector<unsigned> cand;
+
+    unsigned long _attempts;
+    unsigned long _formed;
+    unsigned long _accepted;
+    unsigned long _flippedSpins;
+};
+
+#endif //LOOPUPDATE_H
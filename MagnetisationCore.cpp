@@ -1,23 +1,20 @@
 #include "MagnetisationCore.h"
 
+#include <cmath>
+#include <algorithm>
+
 MagnetisationCore::MagnetisationCore(const std::string & parameterId, 
     PartArray * prototype,
     const Vect & vector, 
-    const std::vector<uint64_t> & spins):
-CalculationParameter(parameterId,prototype),
-vector(vector),
-spins(spins),
+    std::shared_ptr<const MagnetisationVector::Plan> plan):
+MagnetisationVectorParameter(parameterId,prototype,plan),
+axis(vector),
 mv(0,1024*8),
 mv2(0,2048*8),
 mv4(0,3076*8),
-mOld(0),
 _sumModule(false)
 {
-    if (this->spins.size() == 0) {
-        this->spins.resize(this->prototype->size(),0);
-        for (uint64_t i=0; i<this->prototype->size(); ++i) this->spins[i]=i;
-    }
-    this->vector.setUnitary();
+    this->axis.setUnitary();
 
     this->prototypeInit(prototype);
 }
@@ -31,10 +28,10 @@ void MagnetisationCore::printHeader(unsigned num) const
 {
     // get saturation magnetisation
     double saturation=0;
-    for (auto s : this->spins){
-        saturation += fabs(this->prototype->parts[s]->m.scalar(this->vector));
+    for (auto s : this->getPlan()->spins){
+        saturation += fabs(this->prototype->parts[s]->m.scalar(this->axis));
     }
-    saturation /= this->spins.size();
+    saturation /= this->getPlan()->spins.size();
 
 
     printf("##### calculation param #%d #####\n",num);
@@ -47,18 +44,18 @@ void MagnetisationCore::printHeader(unsigned num) const
     printf("# id: %s\n",this->parameterId().c_str());
 
     printf("# magnetisation vector: (%g|%g|%g); initial value %g\n",
-        this->vector.x,
-        this->vector.y,
-        this->vector.z,
-        this->getFullTotal(this->prototype)/this->spins.size());
+        this->axis.x,
+        this->axis.y,
+        this->axis.z,
+        this->value());
     printf("# saturation magnetisation / N: %g\n", saturation);
     printf("# spins: ");
-    if (this->spins.size()==this->prototype->size()){
+    if (this->getPlan()->spins.size()==this->prototype->size()){
         printf("All\n");
     } else {
-        printf("%d",this->spins[0]);
-        for (int ss=1; ss<this->spins.size(); ++ss){
-            printf(",%d",this->spins[ss]);
+        printf("%d",this->getPlan()->spins[0]);
+        for (int ss=1; ss<this->getPlan()->spins.size(); ++ss){
+            printf(",%d",this->getPlan()->spins[ss]);
         }
         printf("\n");
     }
@@ -67,62 +64,25 @@ void MagnetisationCore::printHeader(unsigned num) const
     return;
 }
 
-bool MagnetisationCore::init(PartArray * sys)
+double MagnetisationCore::value() const
 {
-
-    //clear
-    magnetisationValues.clear();
-    
-    this->sys = sys;
-    magnetisationValues.resize(sys->size(),0);
-
-    for (auto spinId: spins){
-        Part* part = sys->parts[spinId];
-        magnetisationValues[spinId] = part->m.scalar(vector);
-        if (part->state)
-            magnetisationValues[spinId] *= -1;
-        
-    }
-
-    this->mOld = getFullTotal(this->sys);
-
-    return true;
-}
-
-void MagnetisationCore::iterate(unsigned id){
-    this->mOld += 2*this->method(id,this->sys);
-    if (_debug){
-        double res = this->getFullTotal(this->sys);
-        if (fabs(res-this->mOld)>0.01) 
-            cerr<<"# (dbg MagnetisationCore#"<<this->parameterId()<<") total value is different: iterative="<<this->mOld<<", full="<<res<<endl;
-    }
+    return this->vector->value().scalar(this->axis) / this->spinsCount();
 }
 
 void MagnetisationCore::incrementTotal(){
-    double addVal = double(this->mOld) / this->spins.size();
-    if (this->_sumModule)
+    double addVal = this->value();
+    if (this->_sumModule){
         this->mv += fabs(addVal);
-    else
+        this->_binning.add(fabs(addVal));
+    } else {
         this->mv += addVal;
+        this->_binning.add(addVal);
+    }
     this->mv2 += addVal*addVal;
     if (this->_binder)
         this->mv4 += addVal*addVal*addVal*addVal;
 }
 
-double MagnetisationCore::getFullTotal(const PartArray * _sys) const
-{
-    double res = 0;
-    for (auto spinId: spins){
-        res += this->method(spinId, _sys);
-    }
-    return res;
-}
-
-double MagnetisationCore::method(unsigned spinId, const PartArray * _sys) const
-{
-        return magnetisationValues[spinId]*((_sys->parts[spinId]->state)?-1:+1);
-}
-
 void MagnetisationCore::setModule(bool module)
 {
     this->_sumModule = module;
@@ -4,12 +4,13 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>
 #include <gmpxx.h>
 #include <cstdint>
 #include "PartArray.h"
-#include "CalculationParameter.h"
+#include "MagnetisationVector.h"
 
-class MagnetisationCore: public CalculationParameter
+class MagnetisationCore: public MagnetisationVectorParameter
 {
 
 public:
@@ -17,14 +18,13 @@ public:
     MagnetisationCore(const std::string & parameterId,
         PartArray * prototype,
         const Vect & vector, 
-        const std::vector<uint64_t> & spins);
+        std::shared_ptr<const MagnetisationVector::Plan> plan);
 
     virtual bool check(unsigned) const;
     virtual void printHeader(unsigned) const;
-    virtual bool init(PartArray * sys);
 
-    virtual void iterate(unsigned id);
     virtual void incrementTotal();
+    virtual double value() const;
     virtual mpf_class getTotal(unsigned steps){ return this->mv / steps; }
     virtual mpf_class getTotal2(unsigned steps){ return this->mv2 / steps; }
     virtual mpf_class getTotal4(unsigned steps){ return this->mv4 / steps; }
@@ -34,19 +34,12 @@ public:
     void setModule(bool module);
 
 private:
-    double method(unsigned spinId, const PartArray * _sys) const;
+    Vect axis;
 
-    double getFullTotal(const PartArray * _sys) const;
-
-    Vect vector;
-    std::vector<uint64_t> spins;
-    std::vector< double > magnetisationValues;
-
-    double mOld;
     mpf_class mv;
     mpf_class mv2;
     mpf_class mv4;
     double _sumModule;
 };
 
-#endif //MAGNETISATIONCORE_H
\ No newline at end of file
+#endif //MAGNETISATIONCORE_H
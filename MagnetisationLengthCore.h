@@ -4,26 +4,26 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>
 #include <gmpxx.h>
 #include <cstdint>
 #include "PartArray.h"
-#include "CalculationParameter.h"
+#include "MagnetisationVector.h"
 
-class MagnetisationLengthCore: public CalculationParameter
+class MagnetisationLengthCore: public MagnetisationVectorParameter
 {
 
 public:
 
     MagnetisationLengthCore(const std::string & parameterId,
         PartArray * prototype,
-        const std::vector<uint64_t> & spins);
+        std::shared_ptr<const MagnetisationVector::Plan> plan);
 
     virtual bool check(unsigned) const;
     virtual void printHeader(unsigned) const;
-    virtual bool init(PartArray * sys);
 
-    virtual void iterate(unsigned id);
     virtual void incrementTotal();
+    virtual double value() const;
     virtual mpf_class getTotal(unsigned steps){ return this->mv / steps; }
     virtual mpf_class getTotal2(unsigned steps){ return this->mv2 / steps; }
     virtual mpf_class getTotal4(unsigned steps){ return this->mv4 / steps; }
@@ -31,16 +31,9 @@ public:
     virtual MagnetisationLengthCore * copy() { return new MagnetisationLengthCore(*this); }
 
 private:
-    Vect method(unsigned spinId) const;
-
-    double getFullTotal(Vect & val) const;
-
-    std::vector<uint64_t> spins;
-
-    Vect mOld;
     mpf_class mv;
     mpf_class mv2;
     mpf_class mv4;
 };
 
-#endif //MAGNETISATIONLENGTHCORE_H
\ No newline at end of file
+#endif //MAGNETISATIONLENGTHCORE_H
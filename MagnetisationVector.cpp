@@ -0,0 +1,123 @@
+#include "MagnetisationVector.h"
+
+#include <cmath>
+#include <algorithm>
+#include <map>
+
+std::shared_ptr<const MagnetisationVector::Plan> MagnetisationVector::buildPlan(const PartArray & prototype, std::vector<uint64_t> spins)
+{
+    const unsigned N = prototype.size();
+    if (spins.size() == 0) {
+        spins.resize(N,0);
+        for (uint64_t i=0; i<N; ++i) spins[i]=i;
+    }
+
+    auto p = std::make_shared<Plan>();
+    p->selected.resize(N,false);
+    p->x.resize(N,0);
+    p->y.resize(N,0);
+    p->z.resize(N,0);
+    for (auto spinId: spins){
+        const Part* part = prototype.parts[spinId];
+        const double s = (part->state) ? -1 : +1;
+        p->selected[spinId] = true;
+        p->x[spinId] = s * part->m.x;
+        p->y[spinId] = s * part->m.y;
+        p->z[spinId] = s * part->m.z;
+    }
+    p->spins.swap(spins);
+    return p;
+}
+
+Vect MagnetisationVector::full(const PartArray * sys) const
+{
+    const Plan & p = *this->plan;
+    double mx = 0, my = 0, mz = 0;
+    for (auto spinId: p.spins){
+        const double s = (sys->parts[spinId]->state) ? -1 : +1;
+        mx += s * p.x[spinId];
+        my += s * p.y[spinId];
+        mz += s * p.z[spinId];
+    }
+    return Vect(mx, my, mz);
+}
+
+MagnetisationVectorParameter::MagnetisationVectorParameter(const std::string & parameterId, PartArray * prototype,
+    std::shared_ptr<const MagnetisationVector::Plan> plan):
+CalculationParameter(parameterId, prototype),
+vector(std::make_shared<MagnetisationVector>(plan)),
+leader(true)
+{
+}
+
+bool MagnetisationVectorParameter::init(PartArray * sys)
+{
+    this->sys = sys;
+    if (this->leader)
+        this->vector->update(sys);
+    return true;
+}
+
+void MagnetisationVectorParameter::rebuild()
+{
+    // the parameter leads its own vector until shareMagnetisationVectors joins it with the others
+    this->vector = std::make_shared<MagnetisationVector>(MagnetisationVector::buildPlan(*this->prototype, this->getPlan()->spins));
+    this->leader = true;
+}
+
+void MagnetisationVectorParameter::iterate(unsigned id)
+{
+    if (this->leader)
+        this->vector->flip(id, this->sys->parts[id]->state);
+}
+
+bool MagnetisationVectorParameter::affects(unsigned id) const
+{
+    return this->leader && this->vector->getPlan()->selected[id];
+}
+
+void MagnetisationVectorParameter::update()
+{
+    if (this->leader)
+        this->vector->update(this->sys);
+}
+
+double MagnetisationVectorParameter::mismatch() const
+{
+    if (!this->leader)
+        return 0;
+    const Vect res = this->vector->full(this->sys);
+    return (res - this->vector->value()).length() / std::max(1., res.length());
+}
+
+double MagnetisationVectorParameter::iterateCost() const
+{
+    return this->leader ? double(this->spinsCount()) / this->sys->size() : 0.;
+}
+
+double MagnetisationVectorParameter::updateCost() const
+{
+    return this->leader ? this->spinsCount() : 0.;
+}
+
+void MagnetisationVectorParameter::attach(std::shared_ptr<MagnetisationVector> vector, bool leader)
+{
+    this->vector = vector;
+    this->leader = leader;
+}
+
+void shareMagnetisationVectors(std::vector< std::unique_ptr< CalculationParameter > > & parameters)
+{
+    // the plans are compared by their spins, the rebuilt parameters have equal plans in different objects
+    std::map< std::vector<uint64_t>, std::shared_ptr<MagnetisationVector> > vectors;
+    for (auto & cp : parameters){
+        auto mp = dynamic_cast<MagnetisationVectorParameter*>(cp.get());
+        if (!mp)
+            continue;
+        auto & vector = vectors[mp->getPlan()->spins];
+        const bool leader = !vector;
+        if (leader)
+            vector = std::make_shared<MagnetisationVector>(mp->getPlan());
+        mp->attach(vector, leader);
+    }
+}
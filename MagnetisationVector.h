@@ -0,0 +1,87 @@
+#ifndef MAGNETISATIONVECTOR_H
+#define MAGNETISATIONVECTOR_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "PartArray.h"
+#include "CalculationParameter.h"
+
+/**
+ * @brief Magnetisation vector M = sum of s_i*m_i over a subset of spins, tracked once per flip
+ * for all the magnetisation parameters of a chain which count the same spins.
+ * Axis projections, their moduli and the length are taken from M at measurement.
+ */
+class MagnetisationVector
+{
+public:
+    /**
+     * @brief Moments of the spins in the initial state, stored by components.
+     * Built once for every subset and shared read-only by the vectors of all chains.
+     */
+    struct Plan {
+        std::vector<uint64_t> spins;
+        std::vector<bool> selected;
+        std::vector<double> x, y, z; // zero for the spins which are not counted
+    };
+
+    // empty spins means all spins of the system
+    static std::shared_ptr<const Plan> buildPlan(const PartArray & prototype, std::vector<uint64_t> spins);
+
+    explicit MagnetisationVector(std::shared_ptr<const Plan> plan): plan(plan), m(0,0,0) {}
+
+    // spin id is flipped to the given state
+    void flip(unsigned id, bool state)
+    {
+        const double s = state ? -2. : 2.;
+        this->m.x += s * this->plan->x[id];
+        this->m.y += s * this->plan->y[id];
+        this->m.z += s * this->plan->z[id];
+    }
+
+    // full recalculation from the states of the system
+    Vect full(const PartArray * sys) const;
+    void update(const PartArray * sys) { this->m = this->full(sys); }
+
+    const Vect & value() const { return this->m; }
+    const std::shared_ptr<const Plan> & getPlan() const { return this->plan; }
+
+private:
+    std::shared_ptr<const Plan> plan;
+    Vect m;
+};
+
+/**
+ * @brief Parameter calculated from the magnetisation vector of its spins.
+ * The parameters of one chain with the same spins share the vector, see shareMagnetisationVectors,
+ * and only the first of them (the leader) follows the flips and recalculates it.
+ */
+class MagnetisationVectorParameter: public CalculationParameter
+{
+public:
+    MagnetisationVectorParameter(const std::string & parameterId, PartArray * prototype,
+        std::shared_ptr<const MagnetisationVector::Plan> plan);
+
+    virtual bool init(PartArray * sys);
+    virtual void rebuild();
+    virtual void iterate(unsigned id);
+    virtual bool affects(unsigned id) const;
+    virtual void update();
+    virtual double mismatch() const;
+    virtual double iterateCost() const;
+    virtual double updateCost() const;
+
+    void attach(std::shared_ptr<MagnetisationVector> vector, bool leader);
+    const std::shared_ptr<const MagnetisationVector::Plan> & getPlan() const { return this->vector->getPlan(); }
+
+protected:
+    unsigned spinsCount() const { return this->vector->getPlan()->spins.size(); }
+
+    std::shared_ptr<MagnetisationVector> vector;
+    bool leader;
+};
+
+// the magnetisation parameters with the same spins get one vector, the first of them is the leader
+void shareMagnetisationVectors(std::vector< std::unique_ptr< CalculationParameter > > & parameters);
+
+#endif //MAGNETISATIONVECTOR_H
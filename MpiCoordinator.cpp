@@ -0,0 +1,238 @@
+#include "MpiCoordinator.h"
+
+#include <cmath>
+#include <omp.h>
+
+#ifdef USE_MPI
+
+MpiCoordinator::MpiCoordinator(int & argc, char ** & argv)
+{
+    // threads call MPI only inside the critical sections
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_SERIALIZED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &this->_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &this->_size);
+
+    MPI_Comm node;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, this->_rank, MPI_INFO_NULL, &node);
+    MPI_Comm_rank(node, &this->_localRank);
+    MPI_Comm_free(&node);
+
+    const MPI_Aint count = this->isRoot() ? 1 : 0;
+    MPI_Win_allocate(count * sizeof(int), sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD, &this->counter, &this->counterWin);
+    MPI_Win_allocate(count * sizeof(double), sizeof(double), MPI_INFO_NULL, MPI_COMM_WORLD, &this->lowestEnergy, &this->energyWin);
+    if (this->isRoot()){
+        MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, this->energyWin);
+        *this->lowestEnergy = INFINITY;
+        MPI_Win_unlock(0, this->energyWin);
+    }
+    this->last = 0;
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+MpiCoordinator::~MpiCoordinator()
+{
+    MPI_Win_free(&this->counterWin);
+    MPI_Win_free(&this->energyWin);
+    MPI_Finalize();
+}
+
+void MpiCoordinator::startTasks(int first, int last)
+{
+    // the counter is reset when no rank takes the tasks of the previous round
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (this->isRoot()){
+        MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, this->counterWin);
+        *this->counter = first;
+        MPI_Win_unlock(0, this->counterWin);
+    }
+    this->last = last;
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+int MpiCoordinator::nextTask()
+{
+    const int one = 1;
+    int task;
+#pragma omp critical(mpi)
+    {
+        MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, this->counterWin);
+        MPI_Fetch_and_op(&one, &task, MPI_INT, 0, 0, MPI_SUM, this->counterWin);
+        MPI_Win_unlock(0, this->counterWin);
+    }
+    return (task < this->last) ? task : -1;
+}
+
+void MpiCoordinator::reportLowerEnergy(double e)
+{
+#pragma omp critical(mpi)
+    {
+        MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, this->energyWin);
+        MPI_Accumulate(&e, 1, MPI_DOUBLE, 0, 0, 1, MPI_DOUBLE, MPI_MIN, this->energyWin);
+        MPI_Win_unlock(0, this->energyWin);
+    }
+}
+
+bool MpiCoordinator::lowerEnergyReported(double threshold)
+{
+    double e;
+#pragma omp critical(mpi)
+    {
+        MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, this->energyWin);
+        MPI_Get_accumulate(nullptr, 0, MPI_DOUBLE, &e, 1, MPI_DOUBLE, 0, 0, 1, MPI_DOUBLE, MPI_NO_OP, this->energyWin);
+        MPI_Win_unlock(0, this->energyWin);
+    }
+    return e < threshold;
+}
+
+int MpiCoordinator::minRank(double & value)
+{
+    struct { double value; int rank; } in = {value, this->_rank}, out;
+    MPI_Allreduce(&in, &out, 1, MPI_DOUBLE_INT, MPI_MINLOC, MPI_COMM_WORLD);
+    value = out.value;
+    return out.rank;
+}
+
+void MpiCoordinator::maxAll(std::vector<int> & values)
+{
+    MPI_Allreduce(MPI_IN_PLACE, values.data(), values.size(), MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+}
+
+void MpiCoordinator::sumAll(std::vector<double> & values)
+{
+    MPI_Allreduce(MPI_IN_PLACE, values.data(), values.size(), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+}
+
+void MpiCoordinator::gather(const std::vector<char> & local, std::vector<char> & all)
+{
+    const int count = local.size();
+    std::vector<int> counts(this->isRoot() ? this->_size : 0), displacements;
+    MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (this->isRoot()){
+        int offset = 0;
+        for (int c : counts){
+            displacements.push_back(offset);
+            offset += c;
+        }
+        all.resize(offset);
+    }
+    MPI_Gatherv(local.data(), count, MPI_CHAR, all.data(), counts.data(), displacements.data(), MPI_CHAR, 0, MPI_COMM_WORLD);
+}
+
+void MpiCoordinator::scatter(const std::vector<std::vector<char>> & parts, std::vector<char> & local)
+{
+    std::vector<int> counts, displacements;
+    std::vector<char> all;
+    if (this->isRoot()){
+        for (const auto & part : parts){
+            counts.push_back(part.size());
+            displacements.push_back(all.size());
+            all.insert(all.end(), part.begin(), part.end());
+        }
+    }
+    int count;
+    MPI_Scatter(counts.data(), 1, MPI_INT, &count, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    local.resize(count);
+    MPI_Scatterv(all.data(), counts.data(), displacements.data(), MPI_CHAR, local.data(), count, MPI_CHAR, 0, MPI_COMM_WORLD);
+}
+
+void MpiCoordinator::exchange(const std::vector<int> & ranks, std::vector<std::vector<char>> & send, std::vector<std::vector<char>> & recv)
+{
+    std::vector<MPI_Request> requests(2 * ranks.size());
+    for (unsigned q = 0; q < ranks.size(); ++q){
+        MPI_Irecv(recv[q].data(), recv[q].size(), MPI_CHAR, ranks[q], 0, MPI_COMM_WORLD, &requests[2 * q]);
+        MPI_Isend(send[q].data(), send[q].size(), MPI_CHAR, ranks[q], 0, MPI_COMM_WORLD, &requests[2 * q + 1]);
+    }
+    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+}
+
+void MpiCoordinator::broadcast(std::string & value, int root)
+{
+    unsigned long length = value.size();
+    MPI_Bcast(&length, 1, MPI_UNSIGNED_LONG, root, MPI_COMM_WORLD);
+    value.resize(length);
+    MPI_Bcast(&value[0], length, MPI_CHAR, root, MPI_COMM_WORLD);
+}
+
+void MpiCoordinator::broadcast(std::vector<double> & values, int root)
+{
+    unsigned long length = values.size();
+    MPI_Bcast(&length, 1, MPI_UNSIGNED_LONG, root, MPI_COMM_WORLD);
+    values.resize(length);
+    MPI_Bcast(values.data(), length, MPI_DOUBLE, root, MPI_COMM_WORLD);
+}
+
+#else
+
+MpiCoordinator::MpiCoordinator(int &, char ** &):
+_rank(0),
+_size(1),
+_localRank(0),
+last(0),
+counter(0)
+{
+}
+
+MpiCoordinator::~MpiCoordinator()
+{
+}
+
+void MpiCoordinator::startTasks(int first, int last)
+{
+    this->counter = first;
+    this->last = last;
+}
+
+int MpiCoordinator::nextTask()
+{
+    int task;
+#pragma omp atomic capture
+    task = this->counter++;
+    return (task < this->last) ? task : -1;
+}
+
+void MpiCoordinator::reportLowerEnergy(double)
+{
+}
+
+bool MpiCoordinator::lowerEnergyReported(double)
+{
+    return false;
+}
+
+int MpiCoordinator::minRank(double &)
+{
+    return 0;
+}
+
+void MpiCoordinator::maxAll(std::vector<int> &)
+{
+}
+
+void MpiCoordinator::sumAll(std::vector<double> &)
+{
+}
+
+void MpiCoordinator::gather(const std::vector<char> & local, std::vector<char> & all)
+{
+    all = local;
+}
+
+void MpiCoordinator::scatter(const std::vector<std::vector<char>> & parts, std::vector<char> & local)
+{
+    local = parts[0];
+}
+
+void MpiCoordinator::exchange(const std::vector<int> &, std::vector<std::vector<char>> &, std::vector<std::vector<char>> &)
+{
+}
+
+void MpiCoordinator::broadcast(std::string &, int)
+{
+}
+
+void MpiCoordinator::broadcast(std::vector<double> &, int)
+{
+}
+
+#endif
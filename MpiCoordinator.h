@@ -0,0 +1,82 @@
+#ifndef MPICOORDINATOR_H
+#define MPICOORDINATOR_H
+
+#include "defines.h"
+
+#include <string>
+#include <vector>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+/**
+ * @brief Distribution of temperatures over MPI ranks, and over threads inside the rank.
+ * Tasks are taken from the shared counter on rank 0 by one-sided atomic operations, so faster ranks take more tasks.
+ * The lowest energy reported by any rank is kept on rank 0 too, so the other ranks can stop early for restart.
+ * Without MPI (USE_MPI is not set) it is the single rank with the thread-shared counter.
+ * Collective functions should be called by one thread of every rank.
+ */
+class MpiCoordinator
+{
+public:
+    MpiCoordinator(int & argc, char ** & argv);
+    ~MpiCoordinator();
+
+    int rank() const { return this->_rank; }
+    int size() const { return this->_size; }
+    bool isRoot() const { return this->_rank == 0; }
+    // number of the rank among the ranks of the same node
+    int localRank() const { return this->_localRank; }
+
+    // collective: tasks [first,last) are to be taken by nextTask()
+    void startTasks(int first, int last);
+    // thread safe: the next task number, or -1 if all tasks are taken
+    int nextTask();
+
+    // thread safe: report the energy lower than the initial one
+    void reportLowerEnergy(double e);
+    // thread safe: true if any rank has reported energy lower than threshold
+    bool lowerEnergyReported(double threshold);
+
+    // collective: the rank with the minimal value, value is replaced by the minimum
+    int minRank(double & value);
+    // collective: element-wise maximum over ranks
+    void maxAll(std::vector<int> & values);
+
+    // collective: element-wise sum over ranks
+    void sumAll(std::vector<double> & values);
+    // collective: the vectors of all ranks are concatenated in the order of ranks on the root rank
+    void gather(const std::vector<char> & local, std::vector<char> & all);
+    // collective: parts[r] of the root rank is received by rank r as local
+    void scatter(const std::vector<std::vector<char>> & parts, std::vector<char> & local);
+    // send[q] is sent to ranks[q] and recv[q] is received from it, the sizes should be known to both sides
+    void exchange(const std::vector<int> & ranks, std::vector<std::vector<char>> & send, std::vector<std::vector<char>> & recv);
+
+    // collective: copy the value of root rank to all ranks
+    template <class T> void broadcast(T & value, int root)
+    {
+#ifdef USE_MPI
+        MPI_Bcast(&value, sizeof(T), MPI_BYTE, root, MPI_COMM_WORLD);
+#else
+        (void)value; (void)root;
+#endif
+    }
+    void broadcast(std::string & value, int root);
+    void broadcast(std::vector<double> & values, int root);
+
+private:
+    int _rank;
+    int _size;
+    int _localRank;
+    int last;
+#ifdef USE_MPI
+    MPI_Win counterWin;
+    MPI_Win energyWin;
+    int * counter;
+    double * lowestEnergy;
+#else
+    int counter;
+#endif
+};
+
+#endif //MPICOORDINATOR_H
@@ -0,0 +1,258 @@
+#include "MultiSpinCoding.h"
+
+#include <cmath>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+#include <omp.h>
+
+// add the bit word to the bit-sliced counter, bit l of counter[b] is the bit b of the count of lane l
+static inline void addToCounter(uint64_t * counter, unsigned bits, uint64_t x)
+{
+    for (unsigned b = 0; b < bits && x; ++b){
+        const uint64_t carry = counter[b] & x;
+        counter[b] ^= x;
+        x = carry;
+    }
+}
+
+static unsigned bitsFor(unsigned n)
+{
+    unsigned bits = 1;
+    while ((1ull << bits) <= n)
+        ++bits;
+    return bits;
+}
+
+MultiSpinCoding::MultiSpinCoding(PartArray & sys)
+{
+    const unsigned N = sys.size();
+    sys.E(); // make sure the energy table is ready
+
+    offsets.resize(N + 1);
+    degree.resize(N);
+    J = 0;
+    offsets[0] = 0;
+    for (unsigned i = 0; i < N; ++i){
+        unsigned j = 0;
+        for (Part *neigh : sys.neighbours[i]){
+            const double e = sys.eAt(i, j);
+            if (J == 0)
+                J = fabs(e);
+            if (fabs(fabs(e) - J) > 1e-9 * J)
+                throw std::invalid_argument("multispin works only with +-J couplings of the same absolute value");
+            neighbours.push_back(neigh->Id());
+            masks.push_back(e > 0 ? ~0ull : 0ull);
+            ++j;
+        }
+        degree[i] = j;
+        offsets[i + 1] = neighbours.size();
+    }
+    bonds = neighbours.size() / 2;
+}
+
+void MultiSpinCoding::setTemperature(double t)
+{
+    thresholds.clear();
+    for (unsigned z : degree){
+        if (thresholds.size() <= z)
+            thresholds.resize(z + 1);
+        if (!thresholds[z].empty() || z == 0)
+            continue;
+        thresholds[z].resize((z + 1) / 2);
+        for (unsigned u = 0; 2 * u < z; ++u){
+            const double p = (t > 0) ? exp(-2. * J * (z - 2. * u) / t) : 0;
+            thresholds[z][u] = (p >= 1) ? ~0ull : uint64_t(ldexp(p, 64));
+        }
+    }
+}
+
+void MultiSpinCoding::step(std::vector<uint64_t> & state, std::mt19937_64 & generator) const
+{
+    const unsigned N = this->size();
+    std::uniform_int_distribution<unsigned> intDistr(0, N - 1);
+    uint64_t counter[32];
+    std::vector<uint64_t> classes;
+
+    // every trial goes to the random half of the replicas, so a replica gets N trials per step on average
+    // and its sequence of the trial spins is independent of the others
+    for (unsigned sstep = 0; sstep < 2 * N; ++sstep){
+        const unsigned i = intDistr(generator);
+        const uint64_t active = generator();
+        const unsigned z = degree[i];
+        if (z == 0)
+            continue;
+        const unsigned bits = bitsFor(z);
+
+        // count unsatisfied bonds of the spin in every replica
+        std::fill(counter, counter + bits, 0);
+        for (unsigned k = offsets[i]; k < offsets[i + 1]; ++k)
+            addToCounter(counter, bits, state[i] ^ state[neighbours[k]] ^ masks[k]);
+
+        // replicas where the flip increases the energy, split by the count
+        const std::vector<uint64_t> & p = thresholds[z];
+        classes.resize(p.size());
+        uint64_t candidates = 0;
+        for (unsigned u = 0; u < p.size(); ++u){
+            uint64_t m = ~0ull;
+            for (unsigned b = 0; b < bits; ++b)
+                m &= ((u >> b) & 1) ? counter[b] : ~counter[b];
+            classes[u] = m;
+            candidates |= m;
+        }
+
+        // compare the random numbers with the probabilities digit by digit from the highest one,
+        // until every candidate replica is decided
+        uint64_t undecided = candidates & active, accept = 0;
+        for (int d = 63; d >= 0 && undecided; --d){
+            uint64_t digit = 0;
+            for (unsigned u = 0; u < p.size(); ++u){
+                if ((p[u] >> d) & 1)
+                    digit |= classes[u];
+            }
+            const uint64_t r = generator();
+            accept |= undecided & ~r & digit;
+            undecided &= ~(r ^ digit);
+        }
+
+        state[i] ^= (~candidates & active) | accept;
+    }
+}
+
+void MultiSpinCoding::energies(const std::vector<uint64_t> & state, double * e) const
+{
+    const unsigned N = this->size();
+    const unsigned bits = bitsFor(bonds);
+    std::vector<uint64_t> counter(bits, 0);
+    for (unsigned i = 0; i < N; ++i){
+        for (unsigned k = offsets[i]; k < offsets[i + 1]; ++k){
+            if (neighbours[k] > i)
+                addToCounter(counter.data(), bits, state[i] ^ state[neighbours[k]] ^ masks[k]);
+        }
+    }
+    for (unsigned l = 0; l < lanes; ++l){
+        uint64_t unsatisfied = 0;
+        for (unsigned b = 0; b < bits; ++b)
+            unsatisfied |= ((counter[b] >> l) & 1) << b;
+        e[l] = J * (2. * unsatisfied - bonds);
+    }
+}
+
+double multiSpinMonteCarlo(ConfigManager & config, std::string & lowestState)
+{
+    const unsigned N = config.N();
+    const unsigned blocks = (config.getMultiSpin() + MultiSpinCoding::lanes - 1) / MultiSpinCoding::lanes;
+    const unsigned R = blocks * MultiSpinCoding::lanes;
+    const unsigned T = config.temperatures.size();
+    const unsigned measureEvery = config.getMeasureEvery();
+
+    PartArray sys(config.getSystem());
+    config.prepareSystem(sys);
+    const MultiSpinCoding engine(sys);
+
+    // averages of every replica
+    std::vector<double> e(T * R), e2(T * R), e4(T * R);
+    std::vector<double> times(T, 0);
+    double eLowest = INFINITY;
+    std::vector<uint64_t> lowestWords;
+    unsigned lowestLane = 0;
+
+#pragma omp parallel
+    {
+        MultiSpinCoding localEngine(engine);
+        std::vector<uint64_t> state;
+        double energies[MultiSpinCoding::lanes];
+        double eLocalLowest = INFINITY;
+        std::vector<uint64_t> localLowestWords;
+        unsigned localLowestLane = 0;
+
+#pragma omp for schedule(dynamic,1)
+        for (int task = 0; task < int(T * blocks); ++task)
+        {
+            auto time_start = std::chrono::steady_clock::now();
+            const unsigned tt = task / blocks, block = task % blocks;
+            localEngine.setTemperature(config.temperatures[tt]);
+
+            std::mt19937_64 generator(config.getSeed() + task);
+            // every replica starts from its own random state
+            state.resize(N);
+            for (unsigned i = 0; i < N; ++i)
+                state[i] = generator();
+
+            for (unsigned step = 0; step < config.getHeatup(); ++step)
+                localEngine.step(state, generator);
+
+            double * le = &e[tt * R + block * MultiSpinCoding::lanes];
+            double * le2 = &e2[tt * R + block * MultiSpinCoding::lanes];
+            double * le4 = &e4[tt * R + block * MultiSpinCoding::lanes];
+            unsigned measured = 0;
+            for (unsigned step = 0; step < config.getCalculate(); ++step){
+                localEngine.step(state, generator);
+                if ((step + 1) % measureEvery != 0)
+                    continue;
+
+                localEngine.energies(state, energies);
+                for (unsigned l = 0; l < MultiSpinCoding::lanes; ++l){
+                    const double x = energies[l];
+                    le[l] += x;
+                    le2[l] += x * x;
+                    le4[l] += x * x * x * x;
+                    if (x < eLocalLowest){
+                        eLocalLowest = x;
+                        localLowestWords = state;
+                        localLowestLane = l;
+                    }
+                }
+                ++measured;
+            }
+            if (measured > 0){
+                for (unsigned l = 0; l < MultiSpinCoding::lanes; ++l){
+                    le[l] /= measured; le2[l] /= measured; le4[l] /= measured;
+                }
+            }
+
+            auto time_end = std::chrono::steady_clock::now();
+#pragma omp atomic
+            times[tt] += std::chrono::duration_cast<std::chrono::milliseconds>(time_end - time_start).count() / 1000.;
+        }
+
+#pragma omp critical
+        if (eLocalLowest < eLowest){
+            eLowest = eLocalLowest;
+            lowestWords.swap(localLowestWords);
+            lowestLane = localLowestLane;
+        }
+    }
+
+    for (unsigned tt = 0; tt < T; ++tt){
+        const double t = config.temperatures[tt];
+        double me = 0, me2 = 0, me4 = 0, mc = 0, mc2 = 0, ee = 0;
+        for (unsigned r = tt * R; r < (tt + 1) * R; ++r){
+            const double c = (e2[r] - e[r] * e[r]) / (t * t * N);
+            me += e[r]; me2 += e2[r]; me4 += e4[r];
+            ee += e[r] * e[r];
+            mc += c; mc2 += c * c;
+        }
+        me /= R; me2 /= R; me4 /= R; mc /= R; mc2 /= R; ee /= R;
+
+        // pooled heat capacity, errors from the spread between independent replicas
+        const double cT = (me2 - me * me) / (t * t * N);
+        const double errC = (R > 1) ? sqrt(std::max(0., mc2 - mc * mc) / (R - 1)) : 0;
+        const double errE = (R > 1) ? sqrt(std::max(0., ee - me * me) / (R - 1)) : 0;
+
+        printf("%e %.15e %.15e %.15e", t, cT, me, me2);
+        if (config.isBinder())
+            printf(" %.15e", me4);
+        printf(" %u %d %f %e %e\n", R, config.getSeed() + tt * blocks, times[tt], errC, errE);
+    }
+    fflush(stdout);
+
+    if (!lowestWords.empty()){
+        for (unsigned i = 0; i < N; ++i){
+            if (sys.parts[i]->state != bool((lowestWords[i] >> lowestLane) & 1))
+                sys.parts[i]->rotate(false);
+        }
+        lowestState = sys.state.toString();
+    }
+    return eLowest;
+}
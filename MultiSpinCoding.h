@@ -0,0 +1,58 @@
+#ifndef MULTISPINCODING_H
+#define MULTISPINCODING_H
+
+#include <vector>
+#include <string>
+#include <random>
+#include <cstdint>
+#include "PartArray.h"
+#include "ConfigManager.h"
+
+/**
+ * @brief Multi-spin coded Metropolis for the systems with +-J couplings.
+ * States of 64 independent replicas are packed to one uint64_t per spin, bit l is the state of the spin in replica l.
+ * The number of unsatisfied bonds of a spin is counted for all replicas at once by the bit-sliced adder,
+ * and every replica gets its own acceptance decision from the shared stream of random words.
+ * Every replica starts from a random state, and a trial spin is offered only to a random half of the replicas,
+ * so the replicas do not share the sequence of the trial spins.
+ */
+class MultiSpinCoding
+{
+public:
+    static const unsigned lanes = 64;
+
+    // takes the neighbours and bond energies of the prepared system, throws if couplings are not +-J
+    explicit MultiSpinCoding(PartArray & sys);
+
+    void setTemperature(double t);
+
+    // one MC step (N trials per replica on average) of all 64 replicas
+    void step(std::vector<uint64_t> & state, std::mt19937_64 & generator) const;
+
+    // energies of all 64 replicas
+    void energies(const std::vector<uint64_t> & state, double * e) const;
+
+    unsigned size() const { return this->degree.size(); }
+
+private:
+    std::vector<unsigned> offsets;   // neighbours of spin i are in [offsets[i],offsets[i+1])
+    std::vector<unsigned> neighbours;
+    std::vector<uint64_t> masks;     // all ones if the bond is unsatisfied for the same states
+    std::vector<unsigned> degree;
+    unsigned bonds;
+    double J;                        // absolute value of the coupling
+
+    // acceptance probability of the flip with U unsatisfied bonds of degree z,
+    // in units of 2^-64, for 2U < z only (other flips do not increase energy)
+    std::vector< std::vector<uint64_t> > thresholds;
+};
+
+/**
+ * @brief Metropolis for all temperatures with multispin replicas per temperature (rounded up to 64).
+ * Prints energy averages pooled over the replicas and their errors from the spread between replicas.
+ *
+ * @return the lowest energy found, its state is written to lowestState
+ */
+double multiSpinMonteCarlo(ConfigManager & config, std::string & lowestState);
+
+#endif //MULTISPINCODING_H
@@ -0,0 +1,99 @@
+#include "NFoldWay.h"
+
+#include <cmath>
+#include <algorithm>
+#include "misc.h"
+
+NFoldWay::NFoldWay(PartArray & sys, const Vect & field, double t):
+sys(sys),
+field(field),
+t(t)
+{
+    const unsigned N = sys.size();
+    tree.resize(N + 1);
+    rates.resize(N);
+    energyChanges.resize(N);
+    highBit = 1;
+    while (highBit * 2 <= N)
+        highBit *= 2;
+    this->rebuild();
+}
+
+void NFoldWay::rebuild()
+{
+    const unsigned N = sys.size();
+    for (unsigned i = 0; i < N; ++i){
+        energyChanges[i] = deltaEnergy(sys, i, field);
+        rates[i] = (energyChanges[i] <= 0) ? 1. : exp(-energyChanges[i] / t);
+    }
+
+    // linear time construction of the tree
+    std::fill(tree.begin(), tree.end(), 0.);
+    for (unsigned k = 1; k <= N; ++k){
+        tree[k] += rates[k - 1];
+        const unsigned parent = k + (k & -k);
+        if (parent <= N)
+            tree[parent] += tree[k];
+    }
+
+    total = 0;
+    for (double r : rates)
+        total += r;
+}
+
+unsigned NFoldWay::choose(double u) const
+{
+    const unsigned N = sys.size();
+    double rest = u * total;
+    unsigned pos = 0;
+    for (unsigned step = highBit; step > 0; step >>= 1){
+        if (pos + step <= N && tree[pos + step] <= rest){
+            pos += step;
+            rest -= tree[pos];
+        }
+    }
+    // FP error may point out of the tree or to the frozen spin
+    if (pos >= N)
+        pos = N - 1;
+    while (rates[pos] == 0 && pos > 0)
+        --pos;
+    return pos;
+}
+
+void NFoldWay::setRate(unsigned id)
+{
+    const double rate = (energyChanges[id] <= 0) ? 1. : exp(-energyChanges[id] / t);
+    const double diff = rate - rates[id];
+    if (diff == 0)
+        return;
+    rates[id] = rate;
+    total += diff;
+    for (unsigned k = id + 1; k < tree.size(); k += (k & -k))
+        tree[k] += diff;
+}
+
+void NFoldWay::flipped(unsigned id)
+{
+    // all the terms of the flipped spin change the sign,
+    // a neighbour changes by the double of its pair term, the sign is from the new states
+    energyChanges[id] = -energyChanges[id];
+    this->setRate(id);
+    const bool state = sys.parts[id]->state;
+    unsigned j = 0;
+    if (sys.interactionRange() != 0.0){
+        for (Part *neigh : sys.neighbours[id]){
+            const unsigned k = neigh->Id();
+            energyChanges[k] += (neigh->state == state) ? -4. * sys.eAt(id, j) : 4. * sys.eAt(id, j);
+            this->setRate(k);
+            ++j;
+        }
+    } else {
+        for (unsigned k = 0; k < sys.size(); ++k){
+            if (k != id){
+                energyChanges[k] += (sys.parts[k]->state == state) ? -4. * sys.eAt(id, j) : 4. * sys.eAt(id, j);
+                this->setRate(k);
+                ++j;
+            }
+        }
+    }
+}
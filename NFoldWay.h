@@ -0,0 +1,49 @@
+#ifndef NFOLDWAY_H
+#define NFOLDWAY_H
+
+#include <vector>
+#include "PartArray.h"
+
+/**
+ * @brief Rejection-free n-fold way (Bortz-Kalos-Lebowitz) dynamics.
+ * Keeps Metropolis flip rate min(1,exp(-dE/T)) of every spin in a Fenwick tree,
+ * so the spin to flip is chosen proportional to its rate in O(log N).
+ * Time is counted in MC steps (N trials): the waiting time before the next flip
+ * is exponential with the mean 1/totalRate(), so the samples taken at the ends
+ * of the steps are the same as for Metropolis.
+ */
+class NFoldWay
+{
+public:
+    NFoldWay(PartArray & sys, const Vect & field, double t);
+
+    // recalculate rates of all spins, also removes the FP error of the tree
+    void rebuild();
+
+    // spin chosen with the probability proportional to its rate, u is uniform in [0,1)
+    unsigned choose(double u) const;
+
+    // update the rates of the spin and its neighbours after the spin was flipped, O(neighbours)
+    void flipped(unsigned id);
+
+    // sum of the rates, the expected number of flips per MC step
+    double totalRate() const { return this->total; }
+
+    // energy change of the flip of spin id
+    double dE(unsigned id) const { return this->energyChanges[id]; }
+
+private:
+    // rate and the tree from energyChanges[id]
+    void setRate(unsigned id);
+
+    PartArray & sys;
+    const Vect field;
+    const double t;
+    std::vector<double> tree; // Fenwick tree of rates, 1-based
+    std::vector<double> rates;
+    std::vector<double> energyChanges;
+    unsigned highBit; // highest power of two not greater than N
+    double total;
+};
+
+#endif //NFOLDWAY_H
@@ -0,0 +1,207 @@
+#include "PopulationAnnealing.h"
+
+#include <random>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <omp.h>
+#include "misc.h"
+
+double populationAnnealing(ConfigManager & config, std::string & lowestState)
+{
+    const unsigned R = config.getPopulation();
+    const unsigned sweeps = config.getPopulationSweeps();
+    const unsigned N = config.N();
+    const Vect field = config.getField();
+    const unsigned P = config.getParametersCount();
+
+    std::vector<double> temperatures(config.temperatures);
+    std::sort(temperatures.begin(), temperatures.end(), std::greater<double>());
+
+    std::vector< std::vector<bool> > states(R, std::vector<bool>(N));
+    std::vector< std::vector<bool> > newStates(R, std::vector<bool>(N));
+    std::vector<double> energies(R), newEnergies(R), weights(R);
+    std::vector<unsigned> families(R), newFamilies(R);
+
+    default_random_engine generator;
+    generator.seed(config.getSeed());
+    uniform_real_distribution<double> doubleDistr(0, 1);
+
+    // random initial population is the sample of the infinite temperature
+    {
+        uniform_int_distribution<int> bitDistr(0, 1);
+        for (unsigned r = 0; r < R; ++r){
+            for (unsigned i = 0; i < N; ++i)
+                states[r][i] = bitDistr(generator);
+            families[r] = r;
+        }
+    }
+
+    // every thread keeps its system and parameters for all the temperatures
+    const int threads = omp_get_max_threads();
+    std::vector< std::unique_ptr<PartArray> > systems(threads);
+    std::vector< std::vector< std::unique_ptr<CalculationParameter> > > parameters(threads);
+
+#pragma omp parallel num_threads(threads)
+    {
+        const int thread = omp_get_thread_num();
+        systems[thread].reset(new PartArray(config.getSystem()));
+        PartArray & sys = *systems[thread];
+        config.prepareSystem(sys);
+        sys.E(); // make sure the energy table is ready
+
+        config.getParameters(parameters[thread]);
+        for (auto &cp : parameters[thread])
+        {
+            cp->init(&sys);
+        }
+
+#pragma omp for
+        for (int r = 0; r < (int)R; ++r){
+            loadState(sys, states[r]);
+            energies[r] = config.energy(sys);
+        }
+    }
+
+    double lnZ = N * log(2.); // partition function at beta=0
+    double betaOld = 0;
+    double eLowest = INFINITY;
+
+    for (unsigned k = 0; k < temperatures.size(); ++k)
+    {
+        auto time_start = std::chrono::steady_clock::now();
+        const double t = temperatures[k];
+        const double beta = 1. / t;
+
+        { // reweight the population to the new temperature
+            const double dBeta = beta - betaOld;
+            const double eMin = *std::min_element(energies.begin(), energies.end());
+            double wSum = 0;
+            for (unsigned r = 0; r < R; ++r){
+                weights[r] = exp(-dBeta * (energies[r] - eMin));
+                wSum += weights[r];
+            }
+            lnZ += -dBeta * eMin + log(wSum / R);
+            betaOld = beta;
+
+            // systematic resampling keeps the population size constant
+            const double step = wSum / R;
+            const double u = doubleDistr(generator);
+            double cumulative = weights[0];
+            unsigned j = 0;
+            for (unsigned r = 0; r < R; ++r){
+                const double target = (u + r) * step;
+                while (cumulative < target && j < R - 1){
+                    ++j;
+                    cumulative += weights[j];
+                }
+                newStates[r] = states[j];
+                newEnergies[r] = energies[j];
+                newFamilies[r] = families[j];
+            }
+            states.swap(newStates);
+            energies.swap(newEnergies);
+            families.swap(newFamilies);
+        }
+
+        // equilibrate every replica and measure
+        double e = 0, e2 = 0, e4 = 0;
+        std::vector<double> p(P, 0), p2(P, 0), p4(P, 0);
+
+#pragma omp parallel num_threads(threads) reduction(+:e,e2,e4)
+        {
+            const int thread = omp_get_thread_num();
+            PartArray & sys = *systems[thread];
+            auto & calculationParameters = parameters[thread];
+
+            // the sums of the parameters run over all temperatures, only the increment belongs to this one
+            std::vector<mpf_class> base(3 * P);
+            for (unsigned i = 0; i < P; ++i){
+                base[3 * i] = calculationParameters[i]->getTotal(1);
+                base[3 * i + 1] = calculationParameters[i]->getTotal2(1);
+                base[3 * i + 2] = calculationParameters[i]->getTotal4(1);
+            }
+
+            uniform_int_distribution<int> intDistr(0, N - 1); // including right edge
+            uniform_real_distribution<double> localDistr(0, 1);
+            double eLocalLowest = INFINITY;
+            std::string localLowestState;
+
+#pragma omp for schedule(dynamic,16)
+            for (int r = 0; r < (int)R; ++r)
+            {
+                // the random stream depends only on temperature and replica, not on the thread
+                default_random_engine localGenerator;
+                localGenerator.seed(config.getSeed() + (k + 1) * R + r);
+
+                loadState(sys, states[r]);
+                double eOld = energies[r];
+                for (unsigned sweep = 0; sweep < sweeps; ++sweep){
+                    for (unsigned sstep = 0; sstep < N; ++sstep){
+                        const unsigned swapNum = intDistr(localGenerator);
+                        const double dE = deltaEnergy(sys, swapNum, field);
+                        if (dE < 0 || localDistr(localGenerator) <= exp(-dE / t)){
+                            sys.parts[swapNum]->rotate(false);
+                            eOld += dE;
+                        }
+                    }
+                }
+                storeState(sys, states[r]);
+                energies[r] = eOld;
+
+                e += eOld;
+                e2 += eOld * eOld;
+                e4 += eOld * eOld * eOld * eOld;
+                for (auto &cp : calculationParameters)
+                {
+                    cp->update();
+                    cp->incrementTotal();
+                }
+
+                if (eOld < eLocalLowest){
+                    eLocalLowest = eOld;
+                    localLowestState = sys.state.toString();
+                }
+            }
+
+#pragma omp critical
+            {
+                for (unsigned i = 0; i < P; ++i){
+                    p[i] += mpf_class(calculationParameters[i]->getTotal(1) - base[3 * i]).get_d();
+                    p2[i] += mpf_class(calculationParameters[i]->getTotal2(1) - base[3 * i + 1]).get_d();
+                    p4[i] += mpf_class(calculationParameters[i]->getTotal4(1) - base[3 * i + 2]).get_d();
+                }
+                if (eLocalLowest < eLowest){
+                    eLowest = eLocalLowest;
+                    lowestState = localLowestState;
+                }
+            }
+        }
+
+        e /= R; e2 /= R; e4 /= R;
+        const double cT = (e2 - e * e) / (t * t * N);
+
+        std::vector<unsigned> survived(families);
+        std::sort(survived.begin(), survived.end());
+        const long familiesCount = std::unique(survived.begin(), survived.end()) - survived.begin();
+
+        auto time_end = std::chrono::steady_clock::now();
+        auto rtime = std::chrono::duration_cast<std::chrono::milliseconds>(time_end - time_start).count();
+
+        printf("%e %.15e %.15e %.15e", t, cT, e, e2);
+        if (config.isBinder())
+            printf(" %.15e", e4);
+        printf(" %.15e %ld", -t * lnZ / N, familiesCount);
+        for (unsigned i = 0; i < P; ++i){
+            printf(" %.15e %.15e", p[i] / R, p2[i] / R);
+            if (config.isBinder())
+                printf(" %.15e", p4[i] / R);
+        }
+        printf(" %f\n", rtime / 1000.);
+        fflush(stdout);
+    }
+
+    return eLowest;
+}
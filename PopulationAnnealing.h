@@ -0,0 +1,16 @@
+#ifndef POPULATIONANNEALING_H
+#define POPULATIONANNEALING_H
+
+#include "ConfigManager.h"
+
+/**
+ * @brief Population annealing over the temperature list, from the highest temperature to the lowest.
+ * The population of replicas is reweighted and resampled at each temperature,
+ * and every replica makes populationSweeps Metropolis sweeps in between.
+ * Prints thermodynamic averages and free energy for each temperature.
+ *
+ * @return the lowest energy found, its state is written to lowestState
+ */
+double populationAnnealing(ConfigManager & config, std::string & lowestState);
+
+#endif //POPULATIONANNEALING_H
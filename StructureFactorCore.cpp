@@ -0,0 +1,243 @@
+#include "StructureFactorCore.h"
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+StructureFactorCore::StructureFactorCore(const std::string & parameterId,
+    PartArray * prototype,
+    double qmax,
+    unsigned qpoints):
+CalculationParameter(parameterId,prototype),
+_qmax(qmax),
+_qpoints(qpoints),
+measurements(0),
+sv(0,1024*8),
+sv2(0,2048*8),
+sv4(0,3076*8)
+{
+    this->buildPlan();
+
+    this->prototypeInit(prototype);
+}
+
+void StructureFactorCore::buildPlan()
+{
+    const unsigned N = this->prototype->size();
+
+    // the single point grid is q=0
+    const double start = (this->_qpoints > 1) ? -this->_qmax : 0;
+    const double step = (this->_qpoints > 1) ? 2 * this->_qmax / (this->_qpoints - 1) : 0;
+    auto p = std::make_shared<Plan>();
+    for (unsigned i=0; i<this->_qpoints; ++i){
+        for (unsigned j=0; j<this->_qpoints; ++j){
+            p->qx.push_back(start + j * step);
+            p->qy.push_back(start + i * step);
+        }
+    }
+    p->mx.resize(N); p->my.resize(N); p->mz.resize(N);
+    p->planar = true;
+    for (unsigned i=0; i<N; ++i){
+        const Part* part = this->prototype->parts[i];
+        const double s = (part->state) ? -1 : +1;
+        p->mx[i] = s * part->m.x;
+        p->my[i] = s * part->m.y;
+        p->mz[i] = s * part->m.z;
+        if (p->mz[i] != 0)
+            p->planar = false;
+    }
+
+    const unsigned P = this->_qpoints;
+    p->cosX.resize(size_t(N) * P); p->sinX.resize(size_t(N) * P);
+    p->cosY.resize(size_t(N) * P); p->sinY.resize(size_t(N) * P);
+#pragma omp parallel for schedule(static)
+    for (int i=0; i<(int)N; ++i){
+        const Vect & r = this->prototype->parts[i]->pos;
+        for (unsigned a=0; a<P; ++a){
+            const double q = start + a * step;
+            p->cosX[size_t(i) * P + a] = cos(q * r.x);
+            p->sinX[size_t(i) * P + a] = sin(q * r.x);
+            p->cosY[size_t(i) * P + a] = cos(q * r.y);
+            p->sinY[size_t(i) * P + a] = sin(q * r.y);
+        }
+    }
+
+    this->plan = p;
+}
+
+bool StructureFactorCore::check(unsigned) const
+{
+    if (this->_qpoints == 0){
+        cerr<<"error! qpoints of structurefactor "<<this->parameterId()<<" should be greather than 0!"<<endl;
+        return false;
+    }
+    if (this->_qmax < 0){
+        cerr<<"error! qmax of structurefactor "<<this->parameterId()<<" should not be negative!"<<endl;
+        return false;
+    }
+    return true;
+}
+
+void StructureFactorCore::printHeader(unsigned num) const
+{
+    printf("##### calculation param #%d #####\n",num);
+    printf("# type: structure factor\n");
+    printf("# id: %s\n",this->parameterId().c_str());
+    printf("# q grid: %u x %u points, qx and qy in [%g,%g]\n",
+        this->_qpoints, this->_qpoints, -this->_qmax, this->_qmax);
+    printf("# value: max over the grid of |S(q)|^2/N; initial value %g\n", this->value());
+    printf("# <|S(q)|^2>/N: saved to structurefactor_%s_<temperature number>.txt\n", this->parameterId().c_str());
+    printf("# phase tables: %.1f MB\n", 4. * this->plan->cosX.size() * sizeof(double) / 1024 / 1024);
+    printf("#\n");
+}
+
+bool StructureFactorCore::init(PartArray * sys)
+{
+    // the plan is shared, only the amplitudes and the sums belong to the chain
+    this->sys = sys;
+    this->getFullAmplitudes(this->sys, this->amplitudes);
+    this->sqTotal.assign(this->qCount(), 0);
+    this->measurements = 0;
+
+    return true;
+}
+
+void StructureFactorCore::accumulate(unsigned id, double weight, double * amplitudes) const
+{
+    const Plan & p = *this->plan;
+    const unsigned Q = this->qCount();
+    const unsigned P = this->_qpoints;
+    const double * cx = &p.cosX[size_t(id) * P];
+    const double * sx = &p.sinX[size_t(id) * P];
+
+    const double ax = weight * p.mx[id];
+    const double ay = weight * p.my[id];
+    const double az = weight * p.mz[id];
+    // the row b of the grid has qy of the point b and all qx
+    for (unsigned b=0; b<P; ++b){
+        const double cy = p.cosY[size_t(id) * P + b];
+        const double sy = p.sinY[size_t(id) * P + b];
+        double * reX = amplitudes + b * P;
+        double * imX = amplitudes + Q + b * P;
+        double * reY = amplitudes + 2 * Q + b * P;
+        double * imY = amplitudes + 3 * Q + b * P;
+#pragma omp simd
+        for (unsigned a=0; a<P; ++a){
+            const double c = cx[a] * cy - sx[a] * sy;
+            const double s = sx[a] * cy + cx[a] * sy;
+            reX[a] += ax * c;
+            imX[a] += ax * s;
+            reY[a] += ay * c;
+            imY[a] += ay * s;
+        }
+
+        if (!p.planar){
+            double * reZ = amplitudes + 4 * Q + b * P;
+            double * imZ = amplitudes + 5 * Q + b * P;
+#pragma omp simd
+            for (unsigned a=0; a<P; ++a){
+                reZ[a] += az * (cx[a] * cy - sx[a] * sy);
+                imZ[a] += az * (sx[a] * cy + cx[a] * sy);
+            }
+        }
+    }
+}
+
+void StructureFactorCore::getFullAmplitudes(const PartArray * _sys, std::vector<double> & amplitudes) const
+{
+    amplitudes.assign(6 * this->qCount(), 0);
+    for (unsigned i=0; i<_sys->size(); ++i){
+        this->accumulate(i, (_sys->parts[i]->state) ? -1 : +1, amplitudes.data());
+    }
+}
+
+void StructureFactorCore::iterate(unsigned id){
+    // the spin is already flipped, its term changes from -m to +m
+    this->accumulate(id, (this->sys->parts[id]->state) ? -2 : +2, this->amplitudes.data());
+}
+
+double StructureFactorCore::value() const
+{
+    const unsigned Q = this->qCount();
+    const double * a = this->amplitudes.data();
+    double peak = 0;
+    for (unsigned q=0; q<Q; ++q){
+        double s2 = 0;
+        for (unsigned k=0; k<6; ++k)
+            s2 += a[k * Q + q] * a[k * Q + q];
+        peak = std::max(peak, s2);
+    }
+    return peak / this->sys->size();
+}
+
+void StructureFactorCore::update()
+{
+    this->getFullAmplitudes(this->sys, this->amplitudes);
+}
+
+double StructureFactorCore::mismatch() const
+{
+    std::vector<double> full;
+    this->getFullAmplitudes(this->sys, full);
+    const unsigned Q = this->qCount();
+    double res = 0;
+    for (unsigned q=0; q<Q; ++q){
+        double d2 = 0, f2 = 0;
+        for (unsigned k=0; k<6; ++k){
+            const double d = full[k * Q + q] - this->amplitudes[k * Q + q];
+            d2 += d * d;
+            f2 += full[k * Q + q] * full[k * Q + q];
+        }
+        res = std::max(res, sqrt(d2) / std::max(1., sqrt(f2)));
+    }
+    return res;
+}
+
+double StructureFactorCore::iterateCost() const
+{
+    return this->qCount();
+}
+
+double StructureFactorCore::updateCost() const
+{
+    return double(this->sys->size()) * this->qCount();
+}
+
+void StructureFactorCore::incrementTotal(){
+    const unsigned Q = this->qCount();
+    const double * a = this->amplitudes.data();
+    double peak = 0;
+    for (unsigned q=0; q<Q; ++q){
+        double s2 = 0;
+        for (unsigned k=0; k<6; ++k)
+            s2 += a[k * Q + q] * a[k * Q + q];
+        this->sqTotal[q] += s2;
+        peak = std::max(peak, s2);
+    }
+    ++this->measurements;
+
+    double addVal = peak / this->sys->size();
+    this->sv += addVal;
+    this->_binning.add(addVal);
+    this->sv2 += addVal*addVal;
+    if (this->_binder)
+        this->sv4 += addVal*addVal*addVal*addVal;
+}
+
+void StructureFactorCore::save(unsigned num){
+    if (this->measurements == 0)
+        return;
+
+    const std::string fname = "structurefactor_" + this->parameterId() + "_" + std::to_string(num) + ".txt";
+    FILE * f = fopen(fname.c_str(), "w");
+    if (!f){
+        cerr<<"# can not save the structure factor to "<<fname<<endl;
+        return;
+    }
+    fprintf(f, "# qx qy <|S(q)|^2>/N, %lu measurements\n", this->measurements);
+    const double norm = double(this->measurements) * this->sys->size();
+    for (unsigned q=0; q<this->qCount(); ++q){
+        fprintf(f, "%e %e %.15e\n", this->plan->qx[q], this->plan->qy[q], this->sqTotal[q] / norm);
+    }
+    fclose(f);
+}
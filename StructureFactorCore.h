@@ -0,0 +1,80 @@
+#ifndef STRUCTUREFACTORCORE_H
+#define STRUCTUREFACTORCORE_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <gmpxx.h>
+#include "PartArray.h"
+#include "CalculationParameter.h"
+
+/**
+ * @brief Magnetic structure factor S(q) = |sum of s_i*m_i*exp(i*q*r_i)|^2 / N on the grid of q in XY plane.
+ * The Fourier amplitudes are updated on every flip, or recalculated at measurement when it is cheaper.
+ * The value of the parameter is the peak of S(q) over the grid, and <S(q)> of every q is saved to the file.
+ */
+class StructureFactorCore: public CalculationParameter
+{
+
+public:
+    /**
+     * @brief The q grid, phases and moments. They depend only on the geometry and the initial state,
+     * so the plan is built once by the prototype and shared read-only by the copies of all chains.
+     */
+    struct Plan {
+        std::vector<double> qx, qy;
+        // phases along the axes, cos(q_a*x_i) is cosX[i*P+a] for the grid of P values of q,
+        // the phases of the grid are combined from them by the angle addition
+        std::vector<double> cosX, sinX, cosY, sinY;
+        std::vector<double> mx, my, mz; // moments in the initial state
+        bool planar; // all mz are zero, z amplitudes are skipped
+    };
+
+    StructureFactorCore(const std::string & parameterId,
+        PartArray * prototype,
+        double qmax,
+        unsigned qpoints);
+
+    virtual bool check(unsigned) const;
+    virtual void printHeader(unsigned) const;
+    virtual bool init(PartArray * sys);
+    virtual void rebuild() { this->buildPlan(); }
+
+    virtual void iterate(unsigned id);
+    virtual void incrementTotal();
+    virtual double value() const;
+    virtual void update();
+    virtual double mismatch() const;
+    virtual double iterateCost() const;
+    virtual double updateCost() const;
+    virtual mpf_class getTotal(unsigned steps){ return this->sv / steps; }
+    virtual mpf_class getTotal2(unsigned steps){ return this->sv2 / steps; }
+    virtual mpf_class getTotal4(unsigned steps){ return this->sv4 / steps; }
+
+    virtual StructureFactorCore * copy() { return new StructureFactorCore(*this); }
+
+    void save(unsigned num);
+
+private:
+    void buildPlan();
+    unsigned qCount() const { return this->plan->qx.size(); }
+
+    // add weight*m_id*exp(i*q*r_id) to the amplitudes of all q
+    void accumulate(unsigned id, double weight, double * amplitudes) const;
+    void getFullAmplitudes(const PartArray * _sys, std::vector<double> & amplitudes) const;
+
+    double _qmax;
+    unsigned _qpoints;
+    std::shared_ptr<const Plan> plan;
+
+    // real and imaginary parts of x, y and z components, every block has Q values
+    std::vector<double> amplitudes;
+    std::vector<double> sqTotal; // sum of |S(q)|^2 over measurements
+    unsigned long measurements;
+
+    mpf_class sv;
+    mpf_class sv2;
+    mpf_class sv4;
+};
+
+#endif //STRUCTUREFACTORCORE_H
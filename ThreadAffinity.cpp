@@ -0,0 +1,88 @@
+#include "ThreadAffinity.h"
+
+#include <fstream>
+#include <algorithm>
+#include <map>
+#include <omp.h>
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+ThreadAffinity::ThreadAffinity():
+sockets(1)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+        return;
+
+    // physical packages are numbered by the kernel, renumber them from 0
+    std::map<int, int> packages;
+    std::vector<std::pair<int, int>> found; // package and cpu
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu){
+        if (!CPU_ISSET(cpu, &set))
+            continue;
+        int package = 0;
+        std::ifstream f("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/physical_package_id");
+        f >> package;
+        packages[package] = 0;
+        found.push_back({package, cpu});
+    }
+    int number = 0;
+    for (auto & p : packages)
+        p.second = number++;
+    std::sort(found.begin(), found.end());
+    for (auto & f : found){
+        this->cpus.push_back(f.second);
+        this->cpuSockets.push_back(packages[f.first]);
+    }
+    this->sockets = std::max<unsigned>(1, packages.size());
+#endif
+}
+
+void ThreadAffinity::pinThreads(const std::string & mode, int localRank)
+{
+#ifdef __linux__
+    if (this->cpus.empty())
+        return;
+
+    std::vector<int> order;
+    if (mode == "spread"){
+        // i-th cpu of every socket in turn
+        std::vector<std::vector<int>> bySocket(this->sockets);
+        for (unsigned i = 0; i < this->cpus.size(); ++i)
+            bySocket[this->cpuSockets[i]].push_back(this->cpus[i]);
+        for (unsigned i = 0; order.size() < this->cpus.size(); ++i){
+            for (auto & s : bySocket){
+                if (i < s.size())
+                    order.push_back(s[i]);
+            }
+        }
+    } else {
+        order = this->cpus;
+    }
+
+    // ranks bound by the launcher have their own cpus, unbound ranks of the node share all of them
+    const bool bound = this->cpus.size() < (unsigned)sysconf(_SC_NPROCESSORS_ONLN);
+    const unsigned offset = bound ? 0 : localRank * omp_get_num_threads();
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(order[(offset + omp_get_thread_num()) % order.size()], &set);
+    sched_setaffinity(0, sizeof(set), &set);
+#endif
+}
+
+int ThreadAffinity::currentSocket() const
+{
+#ifdef __linux__
+    const int cpu = sched_getcpu();
+    for (unsigned i = 0; i < this->cpus.size(); ++i){
+        if (this->cpus[i] == cpu)
+            return this->cpuSockets[i];
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef THREADAFFINITY_H
+#define THREADAFFINITY_H
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Pinning of OpenMP threads to the cpus allowed for the process, and the sockets of the cpus.
+ * Pinned threads do not migrate between sockets, so the system copies and replicas, which are allocated
+ * and first touched by the thread of their temperature, stay in the memory of its NUMA node.
+ * Works on Linux, on other systems threads are not pinned and all cpus are on socket 0.
+ */
+class ThreadAffinity
+{
+public:
+    ThreadAffinity();
+
+    // collective for the threads of parallel region: pin every thread to its cpu.
+    // close fills the sockets one by one, spread puts the neighbouring threads to different sockets.
+    // If the process may run on all cpus of the node, the ranks of the node take the cpus after the threads
+    // of the lower local ranks, otherwise the threads are pinned inside the binding of the rank
+    void pinThreads(const std::string & mode, int localRank);
+
+    // socket of the cpu the calling thread runs on
+    int currentSocket() const;
+
+    unsigned socketCount() const { return this->sockets; }
+
+private:
+    std::vector<int> cpus;       // allowed cpus sorted by socket
+    std::vector<int> cpuSockets; // socket number of every cpu in cpus
+    unsigned sockets;
+};
+
+#endif //THREADAFFINITY_H
@@ -0,0 +1,321 @@
+#include "WangLandau.h"
+
+#include <random>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <omp.h>
+#include "dos2.h"
+#include "misc.h"
+
+// walker of a single energy window
+struct wangLandauWalker {
+    wangLandauWalker(const PartArray & prototype): sys(prototype) {}
+
+    PartArray sys;
+    default_random_engine generator;
+    CompensatedSum eOld;
+    long k;                   // bin of the current energy, inside the window
+    long kLo, kHi;            // first and last bins of the window
+    std::vector<double> lng;  // ln(g(E)) over the bins of the window
+    std::vector<char> seen;   // bins visited at least once
+    Dos2<double> visits;      // histogram since the last change of ln(f)
+    double lnf;
+    bool oneOverT;
+    bool finished;
+    bool converged;           // ln(f) reached the precision before the step limit
+    bool outOfRange;          // some trial left [wangLandauEmin,wangLandauEmax], so the spectrum is wider
+    unsigned long trials;
+    unsigned long steps;
+    double eLowest;
+    std::string lowestState;
+};
+
+double wangLandau(ConfigManager & config, std::string & lowestState)
+{
+    const long B = config.getWangLandau();
+    const double eMin = config.getWangLandauEmin();
+    const double eMax = config.getWangLandauEmax();
+    const double step = (eMax - eMin) / (B - 1);
+    const unsigned N = config.N();
+    const Vect field = config.getField();
+    const long windows = (config.getWangLandauWindows() > 0) ? config.getWangLandauWindows() : omp_get_max_threads();
+    const long W = std::max<long>(1, std::min<long>(windows, B / 2));
+
+    auto binOf = [&](double e) { return lround((e - eMin) / step); };
+    auto energyOf = [&](long k) { return eMin + k * step; };
+
+    auto time_start = std::chrono::steady_clock::now();
+
+    // windows of equal width, neighbouring windows overlap by WL_WINDOW_OVERLAP
+    const double width = B / (1 + (W - 1) * (1 - WL_WINDOW_OVERLAP));
+    std::vector< std::unique_ptr<wangLandauWalker> > walkers;
+    {
+        PartArray sys(config.getSystem());
+        config.prepareSystem(sys);
+        for (long w = 0; w < W; ++w){
+            walkers.push_back(std::make_unique<wangLandauWalker>(sys));
+            wangLandauWalker & a = *walkers.back();
+            a.kLo = lround(w * (1 - WL_WINDOW_OVERLAP) * width);
+            a.kHi = (w == W - 1) ? B - 1 : std::min<long>(B - 1, lround(a.kLo + width - 1));
+            a.generator.seed(config.getSeed() + w);
+            a.eOld = config.energy(a.sys);
+            a.lng.assign(a.kHi - a.kLo + 1, 0);
+            a.seen.assign(a.kHi - a.kLo + 1, 0);
+            a.visits.resize(energyOf(a.kLo), energyOf(a.kHi), a.kHi - a.kLo + 1);
+            a.visits.clear();
+            a.lnf = 1;
+            a.oneOverT = false;
+            a.finished = false;
+            a.converged = false;
+            a.outOfRange = false;
+            a.trials = 0;
+            a.steps = 0;
+            a.eLowest = a.eOld;
+            a.lowestState = a.sys.state.toString();
+        }
+    }
+
+#pragma omp parallel for schedule(dynamic,1)
+    for (long w = 0; w < W; ++w)
+    {
+        // bring the walker to its window, accepting the flips which do not move it away
+        wangLandauWalker & a = *walkers[w];
+        uniform_int_distribution<int> intDistr(0, N - 1);
+        auto distance = [&](double e){
+            return std::max(0., std::max(energyOf(a.kLo) - step / 2 - e, e - energyOf(a.kHi) - step / 2));
+        };
+        for (unsigned s = 0; s < config.getHeatup() && distance(a.eOld) > 0; ++s){
+            for (unsigned sstep = 0; sstep < N; ++sstep){
+                const unsigned i = intDistr(a.generator);
+                const double dE = deltaEnergy(a.sys, i, field);
+                if (distance(a.eOld + dE) <= distance(a.eOld)){
+                    a.sys.parts[i]->rotate(false);
+                    a.eOld += dE;
+                }
+            }
+        }
+        a.eOld = config.energy(a.sys);
+        a.k = binOf(a.eOld) - a.kLo;
+    }
+
+    for (auto & a : walkers){
+        if (a->k < 0 || a->k > a->kHi - a->kLo)
+            throw std::invalid_argument("Wang-Landau window [" + std::to_string(energyOf(a->kLo)) + "," +
+                std::to_string(energyOf(a->kHi)) + "] is not reached in heatup steps, check wangLandauEmin and wangLandauEmax");
+    }
+
+    default_random_engine generator;
+    generator.seed(config.getSeed());
+    uniform_real_distribution<double> doubleDistr(0, 1);
+    unsigned long round = 0;
+    unsigned long exchanges = 0, exchangeAttempts = 0;
+
+    auto allFinished = [&](){
+        for (auto & a : walkers)
+            if (!a->finished) return false;
+        return true;
+    };
+
+    while (!allFinished())
+    {
+#pragma omp parallel for schedule(dynamic,1)
+        for (long w = 0; w < W; ++w)
+        {
+            wangLandauWalker & a = *walkers[w];
+            if (a.finished)
+                continue;
+
+            uniform_int_distribution<int> intDistr(0, N - 1);
+            uniform_real_distribution<double> localDistr(0, 1);
+            const long size = a.kHi - a.kLo + 1;
+
+            for (unsigned s = 0; s < WL_EXCHANGE_EVERY && !a.finished; ++s){
+                for (unsigned sstep = 0; sstep < N; ++sstep){
+                    const unsigned i = intDistr(a.generator);
+                    const double dE = deltaEnergy(a.sys, i, field);
+                    const long kNew = binOf(a.eOld + dE) - a.kLo;
+                    if (kNew + a.kLo < 0 || kNew + a.kLo >= B)
+                        a.outOfRange = true;
+                    if (kNew >= 0 && kNew < size && log(localDistr(a.generator)) <= a.lng[a.k] - a.lng[kNew]){
+                        a.sys.parts[i]->rotate(false);
+                        a.eOld += dE;
+                        a.k = kNew;
+                        if (a.eOld < a.eLowest){
+                            a.eLowest = a.eOld;
+                            a.lowestState = a.sys.state.toString();
+                        }
+                    }
+                    a.lng[a.k] += a.lnf;
+                    a.seen[a.k] = 1;
+                    ++a.visits[energyOf(a.kLo + a.k)];
+                    ++a.trials;
+                }
+                ++a.steps;
+
+                // energy is tracked without drift, the full recalculation is only the optional check
+                if (config.getValidateEvery() > 0 && a.steps % config.getValidateEvery() == 0){
+                    const double eExact = config.energy(a.sys);
+                    if (fabs(eExact - a.eOld) > config.getValidateTolerance() * std::max(1., fabs(eExact)))
+                        cerr << "# Wang-Landau window " << w << ": energy drift " << eExact - a.eOld << " after step " << a.steps << endl;
+                    a.eOld = eExact;
+                    a.k = std::min(std::max(binOf(a.eOld) - a.kLo, 0l), size - 1);
+                }
+
+                if (a.oneOverT){
+                    a.lnf = double(size) / a.trials;
+                } else {
+                    // the histogram is flat if all visited bins have at least WL_FLATNESS of the average
+                    double hMin = INFINITY, hSum = 0;
+                    long hCount = 0;
+                    for (long k = 0; k < size; ++k){
+                        if (!a.seen[k]) continue;
+                        const double h = a.visits[energyOf(a.kLo + k)];
+                        hMin = std::min(hMin, h);
+                        hSum += h;
+                        ++hCount;
+                    }
+                    if (hCount > 0 && hMin >= WL_FLATNESS * hSum / hCount){
+                        a.visits.clear();
+                        a.lnf /= 2;
+                        if (a.lnf < double(size) / a.trials){
+                            a.oneOverT = true;
+                            a.lnf = double(size) / a.trials;
+                        }
+                    }
+                }
+                if (a.lnf < config.getWangLandauPrecision())
+                    a.finished = a.converged = true;
+                else if (a.steps >= config.getWangLandauMaxSteps())
+                    a.finished = true; // the histogram of the window never becomes flat
+            }
+        }
+
+        // replica exchange between neighbouring windows, even and odd pairs in turn
+        for (long w = round % 2; w + 1 < W; w += 2){
+            wangLandauWalker & a = *walkers[w];
+            wangLandauWalker & b = *walkers[w + 1];
+            const long kaInB = a.k + a.kLo - b.kLo;
+            const long kbInA = b.k + b.kLo - a.kLo;
+            if (kaInB < 0 || kaInB > b.kHi - b.kLo || kbInA < 0 || kbInA > a.kHi - a.kLo)
+                continue;
+            ++exchangeAttempts;
+            const double lnP = a.lng[a.k] - a.lng[kbInA] + b.lng[b.k] - b.lng[kaInB];
+            if (log(doubleDistr(generator)) <= lnP){
+                std::vector<bool> sa(N), sb(N);
+                storeState(a.sys, sa);
+                storeState(b.sys, sb);
+                loadState(a.sys, sb);
+                loadState(b.sys, sa);
+                std::swap(a.eOld, b.eOld);
+                a.k = kbInA;
+                b.k = kaInB;
+                ++exchanges;
+            }
+        }
+        ++round;
+    }
+
+    // join the windows where the slopes of ln(g) are the closest
+    std::vector<double> lng(B, -INFINITY);
+    for (long k = walkers[0]->kLo; k <= walkers[0]->kHi; ++k){
+        if (walkers[0]->seen[k - walkers[0]->kLo])
+            lng[k] = walkers[0]->lng[k - walkers[0]->kLo];
+    }
+    for (long w = 1; w < W; ++w){
+        const wangLandauWalker & a = *walkers[w - 1];
+        const wangLandauWalker & b = *walkers[w];
+        long kJoin = -1;
+        double best = INFINITY;
+        for (long k = b.kLo; k < a.kHi; ++k){
+            if (std::isinf(lng[k]) || std::isinf(lng[k + 1]) || !b.seen[k - b.kLo] || !b.seen[k + 1 - b.kLo])
+                continue;
+            const double diff = fabs((lng[k + 1] - lng[k]) - (b.lng[k + 1 - b.kLo] - b.lng[k - b.kLo]));
+            if (diff < best){
+                best = diff;
+                kJoin = k;
+            }
+        }
+        if (kJoin < 0)
+            throw std::invalid_argument("Wang-Landau windows " + std::to_string(w - 1) + " and " + std::to_string(w) +
+                " have no common visited energies, decrease the number of windows");
+        const double shift = lng[kJoin] - b.lng[kJoin - b.kLo];
+        for (long k = kJoin; k <= b.kHi; ++k)
+            lng[k] = b.seen[k - b.kLo] ? b.lng[k - b.kLo] + shift : -INFINITY;
+    }
+
+    // the sum of g(E) is 2^N only if the range covers the whole spectrum,
+    // otherwise ln(g) is relative to the lowest visited energy and the free energy is unknown
+    bool fullSpectrum = true;
+    for (auto & a : walkers)
+        if (a->outOfRange) fullSpectrum = false;
+    double norm;
+    if (fullSpectrum){
+        const double lngMax = *std::max_element(lng.begin(), lng.end());
+        double sum = 0;
+        for (double x : lng)
+            if (!std::isinf(x)) sum += exp(x - lngMax);
+        norm = N * log(2.) - lngMax - log(sum);
+    } else {
+        const auto lowest = std::find_if(lng.begin(), lng.end(), [](double x){ return !std::isinf(x); });
+        norm = -*lowest;
+        cerr << "# warning! Wang-Landau walk left [wangLandauEmin,wangLandauEmax], g(E) is not normalized and F/N is not calculated" << endl;
+    }
+    for (double & x : lng)
+        x += norm;
+
+    auto time_end = std::chrono::steady_clock::now();
+    auto rtime = std::chrono::duration_cast<std::chrono::milliseconds>(time_end - time_start).count();
+
+    for (long w = 0; w < W; ++w){
+        const wangLandauWalker & a = *walkers[w];
+        printf("# window %ld: E in [%g,%g], %lu MC steps\n", w, energyOf(a.kLo), energyOf(a.kHi), a.steps);
+        if (!a.converged)
+            cerr << "# warning! Wang-Landau window " << w << " stopped after " << a.steps << " MC steps with ln(f)=" << a.lnf << endl;
+    }
+    printf("# exchanges accepted: %lu of %lu\n", exchanges, exchangeAttempts);
+
+    std::ofstream dosFile(config.getDosFileName());
+    if (fullSpectrum)
+        dosFile << "# E\tln(g(E)), normalized to 2^N" << std::endl;
+    else
+        dosFile << "# E\tln(g(E)), relative to the lowest energy" << std::endl;
+    for (long k = 0; k < B; ++k){
+        if (!std::isinf(lng[k]))
+            dosFile << energyOf(k) << "\t" << lng[k] << std::endl;
+    }
+    dosFile.close();
+
+    for (double t : config.temperatures){
+        // reweight ln(g) to the temperature with the largest term factored out
+        double lnMax = -INFINITY;
+        for (long k = 0; k < B; ++k)
+            if (!std::isinf(lng[k])) lnMax = std::max(lnMax, lng[k] - energyOf(k) / t);
+        double z = 0, e = 0, e2 = 0, e4 = 0;
+        for (long k = 0; k < B; ++k){
+            if (std::isinf(lng[k])) continue;
+            const double x = energyOf(k);
+            const double p = exp(lng[k] - x / t - lnMax);
+            z += p; e += x * p; e2 += x * x * p; e4 += x * x * x * x * p;
+        }
+        e /= z; e2 /= z; e4 /= z;
+        const double cT = (e2 - e * e) / (t * t * N);
+
+        printf("%e %.15e %.15e %.15e", t, cT, e, e2);
+        if (config.isBinder())
+            printf(" %.15e", e4);
+        printf(" %.15e %f\n", fullSpectrum ? -t * (lnMax + log(z)) / N : NAN, rtime / 1000.);
+    }
+    fflush(stdout);
+
+    double eLowest = INFINITY;
+    for (auto & a : walkers){
+        if (a->eLowest < eLowest){
+            eLowest = a->eLowest;
+            lowestState = a->lowestState;
+        }
+    }
+    return eLowest;
+}
@@ -0,0 +1,17 @@
+#ifndef WANGLANDAU_H
+#define WANGLANDAU_H
+
+#include "ConfigManager.h"
+
+/**
+ * @brief Wang-Landau random walk in energy space, with switch to 1/t algorithm at the end.
+ * Energy range [wangLandauEmin,wangLandauEmax] is split to overlapping windows,
+ * each window has its own walker on a separate thread, and walkers of neighbouring windows
+ * exchange configurations. The pieces of ln(g(E)) are joined where their slopes are the closest.
+ * Prints thermodynamic averages for every temperature of the list and saves g(E) to the file.
+ *
+ * @return the lowest energy found, its state is written to lowestState
+ */
+double wangLandau(ConfigManager & config, std::string & lowestState);
+
+#endif //WANGLANDAU_H
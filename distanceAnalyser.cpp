@@ -1,5 +1,12 @@
 #include <iostream>
 #include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <omp.h>
 #include "PartArray.h"
 #include "Part.h"
 #include <argumentum/argparse.h>
@@ -7,19 +14,235 @@
 using namespace std;
 using namespace argumentum;
 
+// rows are formatted in blocks of this size, so the memory does not depend on the system size
+#define BLOCK_SIZE 1024
+#define BLOCK_BYTES (16 << 20) // limit of the buffer of one thread in the dense output
+
+// uniform grid on XY plane with cell size not smaller than the maximal distance,
+// so all pairs within the distance are in the neighbouring cells
+class SpatialGrid
+{
+public:
+    SpatialGrid(const PartArray & sys, double cell): cell(cell)
+    {
+        minX = minY = INFINITY;
+        double maxX = -INFINITY, maxY = -INFINITY;
+        for (auto p : sys.parts){
+            minX = std::min(minX, p->pos.x); maxX = std::max(maxX, p->pos.x);
+            minY = std::min(minY, p->pos.y); maxY = std::max(maxY, p->pos.y);
+        }
+        // cells not smaller than the average area per spin, so there are O(N) cells even for a short range
+        if (sys.size() > 0){
+            const double w = maxX - minX, h = maxY - minY;
+            this->cell = std::max({cell, sqrt(w * h / sys.size()), std::max(w, h) / sys.size()});
+        }
+        nx = (sys.size() > 0) ? int64_t((maxX - minX) / this->cell) + 1 : 0;
+        ny = (sys.size() > 0) ? int64_t((maxY - minY) / this->cell) + 1 : 0;
+        cells.resize(nx * ny);
+        for (unsigned i = 0; i < sys.size(); ++i)
+            cells[cellX(sys.parts[i]) + nx * cellY(sys.parts[i])].push_back(i);
+    }
+
+    // call f(j) for every spin j which may be within the distance of part
+    template<class F> void forNeighbours(const Part * part, F f) const
+    {
+        const int64_t cx = cellX(part), cy = cellY(part);
+        for (int64_t y = std::max<int64_t>(cy - 1, 0); y <= std::min(cy + 1, ny - 1); ++y)
+            for (int64_t x = std::max<int64_t>(cx - 1, 0); x <= std::min(cx + 1, nx - 1); ++x)
+                for (unsigned j : cells[x + nx * y])
+                    f(j);
+    }
+
+private:
+    int64_t cellX(const Part * p) const { return int64_t((p->pos.x - minX) / cell); }
+    int64_t cellY(const Part * p) const { return int64_t((p->pos.y - minY) / cell); }
+
+    double cell, minX, minY;
+    int64_t nx, ny;
+    std::vector< std::vector<unsigned> > cells;
+};
+
+struct PairRecord {
+    uint32_t a;
+    uint32_t b;
+    double distance;
+};
+
+void printDense(PartArray & sys, bool binary)
+{
+    const int64_t N = sys.size();
+
+    if (!binary){
+        printf("id");
+        for (auto partA:sys.parts){
+            printf(";%ld",partA->Id());
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+
+    // a row has N cells, so the rows in a block are limited by the size of the buffer
+    const int64_t cellBytes = binary ? sizeof(double) : 12;
+    const int64_t rows = std::max<int64_t>(1, std::min<int64_t>(BLOCK_SIZE, BLOCK_BYTES / (cellBytes * std::max<int64_t>(1, N))));
+
+#pragma omp parallel for ordered schedule(static,1)
+    for (int64_t b = 0; b < (N + rows - 1) / rows; ++b)
+    {
+        std::string buf;
+        char cell[32];
+        const int64_t end = std::min<int64_t>((b + 1) * rows, N);
+        buf.reserve((end - b * rows) * cellBytes * N);
+        for (int64_t i = b * rows; i < end; ++i){
+            Part * partA = sys.parts[i];
+            if (!binary)
+                buf.append(cell, snprintf(cell, sizeof(cell), "%ld", partA->Id()));
+            for (auto partB:sys.parts){
+                double d = partA->pos.space(partB->pos);
+                if (binary)
+                    buf.append((const char*)&d, sizeof(d));
+                else
+                    buf.append(cell, snprintf(cell, sizeof(cell), ";%f", d));
+            }
+            if (!binary)
+                buf.push_back('\n');
+        }
+#pragma omp ordered
+        fwrite(buf.data(), 1, buf.size(), stdout);
+    }
+}
+
+void printSparse(PartArray & sys, double minRange, double maxRange, bool binary)
+{
+    const int64_t N = sys.size();
+    const double min2 = minRange * minRange;
+    const double max2 = maxRange * maxRange;
+    SpatialGrid grid(sys, maxRange);
+
+    if (!binary)
+        printf("id1;id2;distance\n");
+    fflush(stdout);
+
+#pragma omp parallel for ordered schedule(static,1)
+    for (int64_t b = 0; b < (N + BLOCK_SIZE - 1) / BLOCK_SIZE; ++b)
+    {
+        std::string buf;
+        char line[64];
+        std::vector<unsigned> pairs;
+        const int64_t end = std::min<int64_t>((b + 1) * BLOCK_SIZE, N);
+        for (int64_t i = b * BLOCK_SIZE; i < end; ++i){
+            Part * partA = sys.parts[i];
+            pairs.clear();
+            grid.forNeighbours(partA, [&](unsigned j){
+                if (j > i){
+                    double space2 = partA->pos.space_2(sys.parts[j]->pos);
+                    if (space2 >= min2 && space2 <= max2)
+                        pairs.push_back(j);
+                }
+            });
+            std::sort(pairs.begin(), pairs.end());
+            for (unsigned j : pairs){
+                Part * partB = sys.parts[j];
+                if (binary){
+                    PairRecord r = {uint32_t(partA->Id()), uint32_t(partB->Id()), partA->pos.space(partB->pos)};
+                    buf.append((const char*)&r, sizeof(r));
+                } else {
+                    buf.append(line, snprintf(line, sizeof(line), "%ld;%ld;%f\n",
+                        partA->Id(), partB->Id(), partA->pos.space(partB->pos)));
+                }
+            }
+        }
+#pragma omp ordered
+        fwrite(buf.data(), 1, buf.size(), stdout);
+    }
+}
+
+void printHistogram(PartArray & sys, double minRange, double maxRange, unsigned bins)
+{
+    const int64_t N = sys.size();
+    const bool limited = !std::isinf(maxRange);
+
+    // without distance limit find the maximal distance first
+    if (!limited){
+        maxRange = 0;
+#pragma omp parallel for reduction(max:maxRange) schedule(dynamic,64)
+        for (int64_t i = 0; i < N; ++i)
+            for (int64_t j = i + 1; j < N; ++j)
+                maxRange = std::max(maxRange, sys.parts[i]->pos.space(sys.parts[j]->pos));
+    }
+
+    const double width = (maxRange > minRange) ? (maxRange - minRange) / bins : 1.;
+    std::vector<unsigned long> histogram(bins, 0);
+    std::unique_ptr<SpatialGrid> grid;
+    if (limited)
+        grid = std::make_unique<SpatialGrid>(sys, maxRange);
+
+#pragma omp parallel
+    {
+        std::vector<unsigned long> local(bins, 0);
+        auto count = [&](int64_t i, int64_t j){
+            if (j <= i) return;
+            double d = sys.parts[i]->pos.space(sys.parts[j]->pos);
+            if (d < minRange || d > maxRange) return;
+            unsigned bin = std::min<unsigned>((d - minRange) / width, bins - 1);
+            ++local[bin];
+        };
+
+        if (limited){
+#pragma omp for schedule(dynamic,64)
+            for (int64_t i = 0; i < N; ++i)
+                grid->forNeighbours(sys.parts[i], [&](unsigned j){ count(i, j); });
+        } else {
+#pragma omp for schedule(dynamic,64)
+            for (int64_t i = 0; i < N; ++i)
+                for (int64_t j = i + 1; j < N; ++j)
+                    count(i, j);
+        }
+
+#pragma omp critical
+        for (unsigned k = 0; k < bins; ++k)
+            histogram[k] += local[k];
+    }
+
+    printf("distance;pairs\n");
+    for (unsigned k = 0; k < bins; ++k){
+        if (histogram[k] > 0)
+            printf("%f;%lu\n", minRange + (k + 0.5) * width, histogram[k]);
+    }
+}
+
 int main(int argc, char* argv[])
 {
     auto parser = argumentum::argument_parser{};
     auto params = parser.params();
 
     std::string filename;
+    double minRange, maxRange;
+    bool sparse = false, binary = false, histogram = false;
+    int bins;
 
     parser.config().program("distanceAnalyser")
         .description("prints out the distance matrix between \
-        all pairs of spins in the system");
+        all pairs of spins in the system, the list of pairs within the distance window, \
+        or the histogram of distances");
     params.add_parameter(filename,"-f","--filename").nargs(1).required().metavar("FILE.mfsys")
         .help("Path to text file with structure of the system. \
             Format is the mfsys file.");
+    params.add_parameter(minRange,"","--minrange").nargs(1).absent(0.).metavar("RANGE")
+        .help("Minimal distance of the pairs for --sparse and --histogram. Default is 0.");
+    params.add_parameter(maxRange,"","--maxrange").nargs(1).absent(-1.).metavar("RANGE")
+        .help("Maximal distance of the pairs for --sparse and --histogram. \
+            Pairs are found with spatial grid, so the time is proportional to the number of pairs. \
+            Default is no limit.");
+    params.add_parameter(sparse,"-s","--sparse").nargs(0)
+        .help("Print only the pairs within the distance window, one pair per line in format id1;id2;distance.");
+    params.add_parameter(histogram,"","--histogram").nargs(0)
+        .help("Print the histogram of pair distances within the distance window, \
+            to choose minrange and maxrange of correlation parameters.");
+    params.add_parameter(bins,"","--bins").nargs(1).absent(100).metavar("N")
+        .help("Number of bins of the histogram. Default is 100.");
+    params.add_parameter(binary,"-b","--binary").nargs(0)
+        .help("Binary output without header. Dense matrix is N*N doubles, \
+            sparse list is the records of (uint32 id1, uint32 id2, double distance).");
 
     auto res = parser.parse_args( argc, argv, 1 );
 
@@ -29,19 +252,24 @@ int main(int argc, char* argv[])
     PartArray sys;
     sys.load(filename);
 
-    printf("id");
-    for (auto partA:sys.parts){
-        printf(";%ld",partA->Id());
-    }
-    printf("\n");
+    if (maxRange <= 0)
+        maxRange = INFINITY;
 
-    for (auto partA:sys.parts){
-        printf("%ld",partA->Id());
-        for (auto partB:sys.parts){
-            printf(";%f",partA->pos.space(partB->pos));
+    if (histogram){
+        if (bins < 1){
+            cerr<<"error! --bins should be greather than 0!"<<endl;
+            return 1;
         }
-        printf("\n");
+        printHistogram(sys, minRange, maxRange, bins);
+    } else if (sparse){
+        if (std::isinf(maxRange)){
+            cerr<<"error! --sparse needs --maxrange to be set"<<endl;
+            return 1;
+        }
+        printSparse(sys, minRange, maxRange, binary);
+    } else {
+        printDense(sys, binary);
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -2,8 +2,11 @@
 #include <string>
 #include <random>
 #include <chrono>
+#include <cmath>
+#include <omp.h>
 #include "PartArray.h"
 #include "Part.h"
+#include "misc.h"
 #include <argumentum/argparse.h>
 
 using namespace std;
@@ -13,8 +16,10 @@ int main(int argc, char* argv[])
 {
 
     int time_secs; //one minute to run
-    int heatupSteps = 10000;
-    double t = 0.000001;
+    int sweeps;
+    int seed;
+    double tMax, tMin, range;
+    std::string schedule;
     auto parser = argumentum::argument_parser{};
     auto params = parser.params();
 
@@ -23,7 +28,8 @@ int main(int argc, char* argv[])
     bool shuffle = false;
 
     parser.config().program("groundStater")
-        .description("Program to find the deeper groundState of magnetic system");
+        .description("Program to find the deeper groundState of magnetic system. \
+            It runs independent simulated annealing restarts on all threads and keeps the best state");
     params.add_parameter(filename,"-f","--filename").nargs(1).required().metavar("FILE.mfsys")
         .help("Path to text file with structure of the system. \
             Format is the mfsys file.");
@@ -34,13 +40,35 @@ int main(int argc, char* argv[])
     params.add_parameter(time_secs,"-t","--time").nargs(1).absent(60)
         .help("time to run the code in seconds. Default is 60s - one minute");
     params.add_parameter(shuffle,"-s","--shuffle").nargs(0)
-        .help("shuffle system states at start");
+        .help("shuffle system states at start of the first restart too. \
+            Other restarts always start from the random state");
+    params.add_parameter(sweeps,"-w","--sweeps").nargs(1).absent(10000).metavar("SWEEPS")
+        .help("Number of MC sweeps in a single annealing restart. Default is 10000");
+    params.add_parameter(tMax,"","--tmax").nargs(1).absent(1.).metavar("T")
+        .help("Temperature at the start of each annealing. Default is 1");
+    params.add_parameter(tMin,"","--tmin").nargs(1).absent(1e-6).metavar("T")
+        .help("Temperature at the end of each annealing. Default is 1e-6");
+    params.add_parameter(schedule,"","--schedule").nargs(1).absent("geometric").metavar("TYPE")
+        .help("Temperature schedule: geometric or linear. Default is geometric");
+    params.add_parameter(range,"","--range").nargs(1).absent(0.).metavar("RANGE")
+        .help("Interaction range, the same as in metropolis. Default is 0 means all-to-all interaction");
+    params.add_parameter(seed,"","--seed").nargs(1).absent(0).metavar("SEED")
+        .help("Random seed. Thread number is added for each thread. Default is 0");
 
     auto res = parser.parse_args( argc, argv, 1 );
 
     if ( !res )
       return 1;
 
+    if (schedule!="geometric" && schedule!="linear"){
+        cerr<<"error! --schedule should be geometric or linear"<<endl;
+        return 1;
+    }
+    if (tMax<tMin || tMin<=0){
+        cerr<<"error! temperatures should be 0 < tmin <= tmax"<<endl;
+        return 1;
+    }
+
     if (rewrite){
         newFilename = filename;
     } else {
@@ -51,54 +79,104 @@ int main(int argc, char* argv[])
         }
     }
 
-    //cout<<filename<<endl<<newFilename<<endl; //return 0;
-
     PartArray sys;
     sys.load(filename);
+    sys.setInteractionRange(range);
 
     const int N = sys.size();
-    const double eInit = sys.E();
-
-    if (shuffle){
-        sys.state.randomize(N);
-        cout<<"system shuffled"<<endl;
+    if (N==0){
+        throw(std::logic_error("System size is 0 or file not found"));
     }
 
-    bool swapRes;
-    unsigned swapNum;
-    double eOld = sys.E();
-    double dE,p,randNum;
+    const double eInit = sys.E();
+    const Vect field(0,0,0);
+
+    double eBest = eInit;
+    std::string bestState = sys.state.toString();
+    unsigned long restartsTotal = 0;
+
+    cout<<"Run simulated annealing for "<<time_secs<<" seconds on "<<omp_get_max_threads()<<" threads"<<endl;
+
+    const auto start_time = std::chrono::steady_clock::now();
+    auto timeIsOver = [&](){
+        return std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now()-start_time).count() >= time_secs;
+    };
+
+#pragma omp parallel reduction(+:restartsTotal)
+    {
+        PartArray tsys(sys);
+        tsys.E(); // prepare the energy table
+
+        default_random_engine generator;
+        generator.seed(seed + omp_get_thread_num());
+        uniform_int_distribution<int> intDistr(0, N-1); // including right edge
+        uniform_real_distribution<double> doubleDistr(0,1); // right edge is not included
+
+        double eThreadBest = eBest;
+        std::string threadBestState = bestState;
+
+        bool first = (omp_get_thread_num() == 0);
+        while (!timeIsOver()){
+            if (!first || shuffle){
+                for (int i=0; i<N; ++i){
+                    if (doubleDistr(generator) < 0.5)
+                        tsys.parts[i]->rotate(false);
+                }
+            }
+            first = false;
+
+            for (int sweep=0; sweep<sweeps; ++sweep){
+                const double x = (sweeps > 1) ? double(sweep)/(sweeps-1) : 1.;
+                const double t = (schedule=="geometric") ?
+                    tMax * pow(tMin/tMax, x) :
+                    tMax + (tMin-tMax) * x;
+
+                for (int sstep=0; sstep<N; ++sstep){
+                    const unsigned swapNum = intDistr(generator);
+                    const double dE = deltaEnergy(tsys, swapNum, field);
+                    if (dE <= 0 || doubleDistr(generator) <= exp(-dE/t)){
+                        tsys.parts[swapNum]->rotate(false);
+                    }
+                }
+
+                if ((sweep & 63) == 0 && timeIsOver())
+                    break;
+            }
 
-    default_random_engine generator;
-    generator.seed(time(NULL));
-    uniform_int_distribution<int> intDistr(0, N-1); // including right edge
-    uniform_real_distribution<double> doubleDistr(0,1); // right edge is not included
+            // zero temperature quench of the final state
+            bool changed = true;
+            while (changed){
+                changed = false;
+                for (int i=0; i<N; ++i){
+                    const double dE = deltaEnergy(tsys, i, field);
+                    if (dE < 0){
+                        tsys.parts[i]->rotate(false);
+                        changed = true;
+                    }
+                }
+            }
 
-    if (N==0){
-        throw(std::logic_error("System size is 0 or file not found"));
-    }
+            const double eOld = tsys.E();
+            if (eOld < eThreadBest){
+                eThreadBest = eOld;
+                threadBestState = tsys.state.toString();
+            }
+            ++restartsTotal;
+        }
 
-    cout<<"Run monte-carlo for "<<time_secs<<" seconds"<<endl;
-
-    auto start_time = std::chrono::high_resolution_clock::now();
-    auto end_time = start_time;
-    do {
-        for (unsigned sstep=0; sstep<N; ++sstep){
-            swapNum = intDistr(generator);
-            sys.parts[swapNum]->rotate(true);
-            dE = eOld - sys.E();
-            p = exp(dE/t);
-            randNum = doubleDistr(generator);
-            if (dE>0 || (t>0 && randNum <= p)){
-                eOld = sys.E();
-            } else {
-                sys.parts[swapNum]->rotate(true);
+#pragma omp critical
+        {
+            if (eThreadBest < eBest){
+                eBest = eThreadBest;
+                bestState = threadBestState;
             }
         }
-        end_time = std::chrono::high_resolution_clock::now();
-    } while(std::chrono::duration_cast<std::chrono::seconds>(end_time-start_time).count() < time_secs);
+    }
+
+    sys.state.fromString(bestState);
 
-    printf("old E: %f, new E: %f\n", eInit, sys.E());
+    printf("restarts: %lu, old E: %f, new E: %f\n", restartsTotal, eInit, sys.E());
     if (sys.E()<eInit){
         cout<<"new state is: "<<sys.state.toString()<<endl;
         sys.state.hardReset();
@@ -109,4 +187,4 @@ int main(int argc, char* argv[])
     }
 
     return 0;
-}
\ No newline at end of file
+}
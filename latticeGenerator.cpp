@@ -0,0 +1,249 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+#include <omp.h>
+#include <argumentum/argparse.h>
+
+using namespace std;
+using namespace argumentum;
+
+// spins are formatted in blocks of this size, so the memory does not depend on the system size
+#define BLOCK_SIZE 65536
+
+struct BasisSpin {
+    double x, y;   // position inside the unit cell, in lattice constant units
+    double mx, my; // unitary magnetic moment
+};
+
+struct Geometry {
+    std::vector<BasisSpin> basis;
+    double ax;       // period along X
+    double ay;       // period along Y
+    double oddShift; // X shift of odd rows (for triangular bravais lattices)
+};
+
+// pentagonal (Cairo) lattice, the same unit cell as in examples/system.mfsys
+// coordinates are given in units of the cell period (1632 in the example)
+static const double pentagonalPeriod = 1632.;
+static const std::vector<BasisSpin> pentagonalCell = {
+    {570.0487853,-314,-0.8660254037,-0.5},
+    {1061.951215,-314,0.8660254037,-0.5},
+    {-314,-245.9512147,-0.5,-0.8660254037},
+    {314,-245.9512147,-0.5,0.8660254037},
+    {0,0,-1,0},
+    {816,0,0,-1},
+    {-314,245.9512147,-0.5,0.8660254037},
+    {314,245.9512147,0.5,0.8660254037},
+    {570.0487853,314,0.8660254037,-0.5},
+    {1061.951215,314,-0.8660254037,-0.5},
+    {-245.9512147,502,0.8660254037,0.5},
+    {245.9512147,502,-0.8660254037,0.5},
+    {502,570.0487853,-0.5,-0.8660254037},
+    {1130,570.0487853,0.5,-0.8660254037},
+    {0,816,0,1},
+    {816,816,-1,0},
+    {502,1061.951215,0.5,-0.8660254037},
+    {1130,1061.951215,-0.5,-0.8660254037},
+    {-245.9512147,1130,-0.8660254037,0.5},
+    {245.9512147,1130,0.8660254037,0.5}
+};
+
+Geometry makeGeometry(const std::string & name)
+{
+    Geometry g;
+    if (name == "square"){
+        g.basis = {{0.5,0,1,0},{0,0.5,0,1}};
+        g.ax = 1; g.ay = 1; g.oddShift = 0;
+    } else if (name == "kagome"){
+        // spins on the bonds of honeycomb lattice, distance between vertices is 1
+        const double s3 = sqrt(3.);
+        g.basis = {
+            {0,0.5,0,1},
+            {s3/4.,-0.25,s3/2.,-0.5},
+            {-s3/4.,-0.25,-s3/2.,-0.5}
+        };
+        g.ax = s3; g.ay = 1.5; g.oddShift = s3/2.;
+    } else if (name == "pentagonal"){
+        for (auto s : pentagonalCell){
+            g.basis.push_back({s.x/pentagonalPeriod, s.y/pentagonalPeriod, s.mx, s.my});
+        }
+        g.ax = 1; g.ay = 1; g.oddShift = 0;
+    } else {
+        throw(std::invalid_argument("Unknown geometry " + name + ". Use square, kagome, pentagonal or random"));
+    }
+    return g;
+}
+
+// counter-based hash, gives the same numbers independently of the threads count
+inline uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+inline double edgeRandom(uint64_t seed, uint64_t i, uint64_t j, uint64_t salt)
+{
+    if (i > j) std::swap(i, j); // symmetric in i and j
+    uint64_t h = splitmix64(splitmix64(splitmix64(seed ^ salt) ^ i) ^ j);
+    return (h >> 11) * 0x1.0p-53;
+}
+
+// k-th number of the stream of spin i, not symmetric
+inline double streamRandom(uint64_t seed, uint64_t i, uint64_t k)
+{
+    uint64_t h = splitmix64(splitmix64(splitmix64(seed ^ 3) ^ i) ^ k);
+    return (h >> 11) * 0x1.0p-53;
+}
+
+void writeMfsys(FILE * f, const Geometry & g, uint64_t nx, uint64_t ny, double a, double m)
+{
+    const uint64_t basisSize = g.basis.size();
+    const uint64_t N = nx * ny * basisSize;
+
+    fprintf(f, "[header]\ndimensions=2\nsize=%lu\nstate=", N);
+    {
+        std::string zeros(BLOCK_SIZE, '0');
+        for (uint64_t i = 0; i < N; i += BLOCK_SIZE)
+            fwrite(zeros.data(), 1, std::min<uint64_t>(BLOCK_SIZE, N - i), f);
+    }
+    fprintf(f, "\n[parts]\n");
+
+    const int64_t blocks = (N + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+#pragma omp parallel for ordered schedule(static,1)
+    for (int64_t b = 0; b < blocks; ++b)
+    {
+        std::string buf;
+        char line[256];
+        buf.reserve(BLOCK_SIZE * 64);
+        const uint64_t end = std::min<uint64_t>((b + 1) * BLOCK_SIZE, N);
+        for (uint64_t id = b * BLOCK_SIZE; id < end; ++id)
+        {
+            const uint64_t cell = id / basisSize;
+            const BasisSpin & s = g.basis[id % basisSize];
+            const uint64_t ix = cell % nx;
+            const uint64_t iy = cell / nx;
+            const double x = (ix * g.ax + (iy % 2) * g.oddShift + s.x) * a;
+            const double y = (iy * g.ay + s.y) * a;
+            int len = snprintf(line, sizeof(line), "%lu\t%.10g\t%.10g\t0\t%.10g\t%.10g\t0\t0\n",
+                id, x, y, s.mx * m, s.my * m);
+            buf.append(line, len);
+        }
+#pragma omp ordered
+        fwrite(buf.data(), 1, buf.size(), f);
+    }
+}
+
+void writeRandomCSV(FILE * f, uint64_t N, double degree, double J, uint64_t seed)
+{
+    const double p = (N > 1) ? degree / (N - 1) : 0;
+
+    // sparse format, one line i;j;J per bond with i<j
+    fprintf(f, "# sparse %lu\n", N);
+#pragma omp parallel for ordered schedule(static,1)
+    for (int64_t i = 0; i < (int64_t)N; ++i)
+    {
+        std::string buf;
+        char line[64];
+        // the gaps between the neighbours j>i are geometric, so only the bonds are drawn, O(N*degree) in total
+        const double logq = (p < 1) ? log1p(-p) : -INFINITY;
+        uint64_t k = 0;
+        for (uint64_t j = i; p > 0; )
+        {
+            const double gap = floor(log1p(-streamRandom(seed, i, k++)) / logq);
+            if (gap >= double(N - 1 - j))
+                break;
+            j += 1 + uint64_t(gap);
+            int len = snprintf(line, sizeof(line), "%ld;%lu;%g\n", i, j, (edgeRandom(seed, i, j, 2) < 0.5) ? -J : J);
+            buf.append(line, len);
+        }
+#pragma omp ordered
+        fwrite(buf.data(), 1, buf.size(), f);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    auto parser = argumentum::argument_parser{};
+    auto params = parser.params();
+
+    std::string geometry, filename;
+    int64_t nx, ny, spins, seed;
+    double lattice, moment, degree, coupling;
+
+    parser.config().program("latticeGenerator")
+        .description("Generates the reproducible input files for metropolis: \
+        artificial spin ice lattices in mfsys format and random graphs in csv format");
+    params.add_parameter(geometry,"-g","--geometry").nargs(1).required().metavar("TYPE")
+        .help("Type of the system: square, kagome, pentagonal or random.");
+    params.add_parameter(filename,"-o","--output").nargs(1).required().metavar("FILE")
+        .help("Output file name. It should be .mfsys for lattices and .csv for random graphs. \
+            Random graphs are written in sparse csv format: the line \"# sparse N\" and then one line i;j;J per bond.");
+    params.add_parameter(nx,"-x","--nx").nargs(1).absent(10).metavar("CELLS")
+        .help("Number of unit cells along X. Default is 10.");
+    params.add_parameter(ny,"-y","--ny").nargs(1).absent(10).metavar("CELLS")
+        .help("Number of unit cells along Y. Default is 10.");
+    params.add_parameter(lattice,"-a","--lattice").nargs(1).absent(1.).metavar("A")
+        .help("Lattice constant. For pentagonal lattice it is the period of the cell \
+            (1632 in examples/system.mfsys). Default is 1.");
+    params.add_parameter(moment,"-m","--moment").nargs(1).absent(1.).metavar("M")
+        .help("Length of magnetic moment of each spin. Default is 1.");
+    params.add_parameter(spins,"-n","--spins").nargs(1).absent(100).metavar("N")
+        .help("Number of spins in random graph. Default is 100.");
+    params.add_parameter(degree,"-d","--degree").nargs(1).absent(3.).metavar("K")
+        .help("Average number of neighbours in random graph. Default is 3.");
+    params.add_parameter(coupling,"-j","--coupling").nargs(1).absent(1.).metavar("J")
+        .help("Absolute value of +-J couplings in random graph. Default is 1.");
+    params.add_parameter(seed,"-s","--seed").nargs(1).absent(0).metavar("SEED")
+        .help("Random seed for random graph. The output does not depend on number of threads. Default is 0.");
+
+    auto res = parser.parse_args( argc, argv, 1 );
+
+    if ( !res )
+      return 1;
+
+    // all the arguments are checked before the file is created
+    Geometry g;
+    if (geometry == "random"){
+        if (spins < 1){
+            cerr<<"error! --spins should be greather than 0!"<<endl;
+            return 1;
+        }
+    } else {
+        if (nx < 1 || ny < 1){
+            cerr<<"error! --nx and --ny should be greather than 0!"<<endl;
+            return 1;
+        }
+        try {
+            g = makeGeometry(geometry);
+        } catch (const std::invalid_argument & e) {
+            cerr<<"error! "<<e.what()<<endl;
+            return 1;
+        }
+    }
+
+    FILE * f = fopen(filename.c_str(), "w");
+    if (!f){
+        cerr<<"Could not open file "<<filename<<" for writing"<<endl;
+        return 1;
+    }
+
+    if (geometry == "random"){
+        writeRandomCSV(f, spins, degree, coupling, seed);
+        printf("random graph of %ld spins saved to %s\n", spins, filename.c_str());
+    } else {
+        writeMfsys(f, g, nx, ny, lattice, moment);
+        printf("%s lattice of %lu spins saved to %s\n",
+            geometry.c_str(), nx * ny * g.basis.size(), filename.c_str());
+    }
+
+    fclose(f);
+
+    return 0;
+}
@@ -7,6 +7,7 @@
 #include <random>
 #include <cmath>
 #include <string>
+#include <sstream>
 #include <bitset>
 #include <gmpxx.h>
 #include <chrono>
@@ -21,6 +22,18 @@
 #include "CommandLineParameters.h"
 #include "ConfigManager.h"
 #include "CalculationParameter.h"
+#include "BinningAnalysis.h"
+#include "EquilibrationDetector.h"
+#include "PopulationAnnealing.h"
+#include "LoopUpdate.h"
+#include "NFoldWay.h"
+#include "MultiSpinCoding.h"
+#include "WangLandau.h"
+#include "EnergyHistogram.h"
+#include "MpiCoordinator.h"
+#include "DomainDecomposition.h"
+#include "ThreadAffinity.h"
+#include "EnergyRecord.h"
 #include <inicpp/inicpp.h>
 #include "misc.h"
 
@@ -33,8 +46,17 @@ struct monteCarloStatistics {
 	string lowerEnergyState;
 	vector<string> finalStates;
 	vector<double> finalEnergies;
-	vector<std::chrono::time_point<std::chrono::steady_clock>> temperature_times_start;
-	vector<std::chrono::time_point<std::chrono::steady_clock>> temperature_times_end;
+	vector<unsigned> calculatedSteps;
+	vector<unsigned> heatupSteps;
+	vector<char> heatupStationary; // automatic heatup ended by the drift test, not by the maximum of steps
+	vector<double> loopsFormed;   // fraction of loop attempts which gave a closed loop
+	vector<double> loopsAccepted; // fraction of closed loops which were flipped
+	vector<double> loopsLength;   // average length of flipped loops
+	vector<long> nfoldSteps;      // MC step when n-fold way was started, -1 if never
+	vector<double> refineValues;  // C(T)/N or susceptibility of refineParameter
+	vector<int> sockets;          // socket of the thread which calculated the temperature
+	vector<double> spinUpdates;   // number of trial flips of all replicas
+	vector<double> temperatureTimes; // running time of all the tasks of the temperature, s
 };
 
 std::string xorstr(std::string s1,std::string s2){
@@ -45,7 +67,7 @@ std::string xorstr(std::string s1,std::string s2){
 	return s;
 }
 
-std::optional<ConfigManager> readParameters(int argc, char *argv[]){
+std::optional<ConfigManager> readParameters(int argc, char *argv[], MpiCoordinator &coordinator){
 
 	// get file name
 	bool parse_failed = false;
@@ -61,7 +83,7 @@ std::optional<ConfigManager> readParameters(int argc, char *argv[]){
 
 	if (!parseResult)
 	{
-		if (commandLineParameters && commandLineParameters->showExample)
+		if (commandLineParameters && commandLineParameters->showExample && coordinator.isRoot())
 		{
 			std::cout << endl;
 			std::cout << "##########################################" << endl;
@@ -79,330 +101,1032 @@ std::optional<ConfigManager> readParameters(int argc, char *argv[]){
 		iniconfig = inicpp::parser::load_file(commandLineParameters->inifilename);
 	}
 
-	ConfigManager config = ConfigManager::init(*(commandLineParameters.get()), iniconfig);
+	ConfigManager config = ConfigManager::init(*(commandLineParameters.get()), iniconfig, coordinator.isRoot());
 
 	bool configError = config.check_config();
 	if (!configError)
 	{
 		cerr << "Program stopped with error" << endl;
 		return {};
-	} else {
+	} else if (coordinator.isRoot()) {
+		config.rankCount = coordinator.size();
 		config.printHeader();
 	}
 
 	return config;
 }
 
-monteCarloStatistics montecarlo(ConfigManager &config){
-	unsigned temperatureCount = config.temperatures.size();
+// midpoints of the intervals of the temperature grid which contain the peak of values or where the values
+// change by more than REFINE_CHANGE of their range, only if the interval is wider than resolution
+std::vector<double> refineTemperatures(const std::vector<double> & temperatures, const std::vector<double> & values, double resolution)
+{
+	std::vector<unsigned> order(temperatures.size());
+	for (unsigned i = 0; i < order.size(); ++i)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](unsigned a, unsigned b) { return temperatures[a] < temperatures[b]; });
+
+	const double vMax = *std::max_element(values.begin(), values.end());
+	const double vMin = *std::min_element(values.begin(), values.end());
+
+	std::vector<double> added;
+	for (unsigned i = 0; i + 1 < order.size(); ++i)
+	{
+		const unsigned a = order[i], b = order[i + 1];
+		if (temperatures[b] - temperatures[a] <= resolution)
+			continue;
+		const bool peak = (values[a] == vMax || values[b] == vMax);
+		const bool steep = fabs(values[b] - values[a]) > REFINE_CHANGE * (vMax - vMin);
+		if (peak || steep)
+			added.push_back((temperatures[a] + temperatures[b]) / 2);
+	}
+	return added;
+}
+
+// independent Markov chain of a temperature. Replicas of the temperature share one system
+// and load their states to it in turn, so the topology and energy table stay in cache
+struct replicaChain {
+	unsigned seed;
+	default_random_engine generator;
+	vector<bool> state;
+	CompensatedSum eOld;
+	std::vector<std::unique_ptr<CalculationParameter>> calculationParameters;
+	mpf_class e{0, 1024 * 8};
+	mpf_class e2{0, 2048 * 8};
+	mpf_class e4{0, 3072 * 8};
+	BinningAnalysis eBinning; // error bars and autocorrelation time of energy
+
+	// observables which are recalculated from state at measurement instead of iterating every flip
+	std::vector<bool> deferred;
+	unsigned long flipsSinceMeasurement;
+	long lastFlip; // spin of the last accepted flip, for validation reports
+
+	// drift test of energy (and parameters) for automatic heatup
+	std::unique_ptr<EquilibrationDetector> equilibration;
+	bool equilibrated;
+
+	// series which precision is checked for adaptive stopping
+	const BinningAnalysis * precisionBinning;
+	bool precisionOfVariance;
+
+	// rejection-free dynamics, started when the acceptance rate falls below the threshold
+	std::unique_ptr<NFoldWay> nfold;
+	double waitingTime; // time to the next flip of n-fold way, in MC steps
+	long nfoldStep;
+};
+
+// results of the replicas [first,first+K) of a temperature, calculated by one thread as one task.
+// The pooled statistics of the temperature are reduced from the blocks when all of them are done
+struct replicaBlock {
+	int owner = -1;          // rank which calculated the block
+	std::string messages;    // heatup report, printed before the results of the temperature
+	std::string records;     // line per replica: thread, seed, averages of energy and parameters, their errors
+	std::string finalState;  // of the first replica of the block
+	double finalEnergy;
+	unsigned calculatedSteps;
+	unsigned heatupSteps;
+	char heatupStationary;
+	long nfoldStep;          // of the first replica of the block
+	unsigned long loopAttempts, loopsFormed, loopsAccepted, loopSpins;
+	double spinUpdates;
+	int socket;
+	double time;             // running time, s
+};
+
+// every rank gets the blocks calculated by other ranks, the statistics of temperatures are reduced from them.
+// The lower energy found by any rank cancels the round on all ranks
+void shareResults(MpiCoordinator &coordinator, monteCarloStatistics &statData,
+	std::vector<replicaBlock> &blocks, int first, int last)
+{
+	double lowerEnergy = statData.foundLowerEnergy ? statData.lowerEnergy : INFINITY;
+	const int finder = coordinator.minRank(lowerEnergy);
+	if (!std::isinf(lowerEnergy))
+	{
+		statData.foundLowerEnergy = true;
+		statData.lowerEnergy = lowerEnergy;
+		coordinator.broadcast(statData.lowerEnergyState, finder);
+		coordinator.broadcast(statData.temperatureOfLowerEnergy, finder);
+		return;
+	}
+
+	std::vector<int> owners(last - first);
+	for (int task = first; task < last; ++task)
+		owners[task - first] = blocks[task].owner;
+	coordinator.maxAll(owners);
+	for (int task = first; task < last; ++task)
+	{
+		replicaBlock & block = blocks[task];
+		const int owner = owners[task - first];
+		block.owner = owner;
+		coordinator.broadcast(block.messages, owner);
+		coordinator.broadcast(block.records, owner);
+		coordinator.broadcast(block.finalState, owner);
+		coordinator.broadcast(block.finalEnergy, owner);
+		coordinator.broadcast(block.calculatedSteps, owner);
+		coordinator.broadcast(block.heatupSteps, owner);
+		coordinator.broadcast(block.heatupStationary, owner);
+		coordinator.broadcast(block.nfoldStep, owner);
+		coordinator.broadcast(block.loopAttempts, owner);
+		coordinator.broadcast(block.loopsFormed, owner);
+		coordinator.broadcast(block.loopsAccepted, owner);
+		coordinator.broadcast(block.loopSpins, owner);
+		coordinator.broadcast(block.spinUpdates, owner);
+		coordinator.broadcast(block.socket, owner);
+		coordinator.broadcast(block.time, owner);
+	}
+}
 
+monteCarloStatistics montecarlo(ConfigManager &config, MpiCoordinator &coordinator, const ThreadAffinity &affinity){
 	monteCarloStatistics statData;
 	statData.foundLowerEnergy = false;
-	statData.finalStates.resize(temperatureCount);
-	statData.finalEnergies.resize(temperatureCount);
-	statData.temperature_times_start.resize(temperatureCount);
-	statData.temperature_times_end.resize(temperatureCount);
+
+	// replicas of a temperature are split into blocks, every block is the task of one thread.
+	// The energy histogram is collected from all replicas, so they are kept in one block then
+	const unsigned replicaCount = config.getReplicas();
+	const unsigned blockSize = (config.getEnergyHistogram() > 0) ? replicaCount : std::min(replicaCount, unsigned(REPLICA_BLOCK));
+	const unsigned blockCount = (replicaCount + blockSize - 1) / blockSize;
+
+	// temperatures are added by the refinement, every temperature may start from its own state
+	std::vector<replicaBlock> blocks;
+	std::vector<unsigned> blocksDone;
+	auto resizeStatistics = [&](unsigned temperatureCount)
+	{
+		blocks.resize(temperatureCount * blockCount);
+		blocksDone.resize(temperatureCount, 0);
+		statData.finalStates.resize(temperatureCount);
+		statData.finalEnergies.resize(temperatureCount);
+		statData.calculatedSteps.resize(temperatureCount);
+		statData.heatupSteps.resize(temperatureCount);
+		statData.heatupStationary.resize(temperatureCount);
+		statData.loopsFormed.resize(temperatureCount);
+		statData.loopsAccepted.resize(temperatureCount);
+		statData.loopsLength.resize(temperatureCount);
+		statData.nfoldSteps.resize(temperatureCount);
+		statData.refineValues.resize(temperatureCount);
+		statData.sockets.resize(temperatureCount);
+		statData.spinUpdates.resize(temperatureCount);
+		statData.temperatureTimes.resize(temperatureCount);
+	};
+	resizeStatistics(config.temperatures.size());
+	std::vector<std::string> startStates(config.temperatures.size());
+	int firstTemperature = 0;
+	int lastTemperature = config.temperatures.size();
+	bool refineDone = false;
 
 	{ // block to get initial energy
-		const Vect field = config.getField();
 		PartArray sys(config.getSystem());
-		if (config.isCSV()){
-			ConfigManager::setCSVEnergies(sys);
-		} else {
-			if (config.isPBC())
+		config.prepareSystem(sys);
+		statData.initEnergy = config.energy(sys);
+		statData.lowerEnergy = statData.initEnergy;
+		statData.deltaEnergy = fabs(statData.initEnergy * config.getRestartThreshold());
+	}
+
+	// the lower energy stops all the temperatures for restart
+	EnergyRecord lowerEnergyRecord(statData.initEnergy - statData.deltaEnergy);
+	CancellationToken restartToken;
+
+	// the flip is passed only to the parameters which depend on the spin
+	std::vector<unsigned> subscriptionOffsets, subscriptions;
+	config.getSubscriptions(subscriptionOffsets, subscriptions);
+
+	// number of the parameter which susceptibility is refined, -1 for the heat capacity
+	int refineParameter = -1;
+	{
+		std::vector<std::unique_ptr<CalculationParameter>> parameters;
+		config.getParameters(parameters);
+		for (unsigned i = 0; i < parameters.size(); ++i)
+		{
+			if (parameters[i]->parameterId() == config.getRefineParameter())
+				refineParameter = i;
+		}
+	}
+
+	// statistics of the temperature from all its blocks, and its output: the replica lines and the pooled line
+	auto reduceTemperature = [&](int tt)
+	{
+		const double t = config.temperatures[tt];
+		const unsigned N = config.N();
+		const unsigned K = replicaCount;
+		const unsigned P = config.getParametersCount();
+
+		char * outBuffer = nullptr;
+		size_t outSize = 0;
+		FILE * out = open_memstream(&outBuffer, &outSize);
+
+		const replicaBlock & first = blocks[tt * blockCount];
+		statData.finalStates[tt] = first.finalState;
+		statData.finalEnergies[tt] = first.finalEnergy;
+		statData.nfoldSteps[tt] = first.nfoldStep;
+		statData.sockets[tt] = first.socket;
+		statData.calculatedSteps[tt] = 0;
+		statData.heatupSteps[tt] = 0;
+		statData.heatupStationary[tt] = true;
+		statData.spinUpdates[tt] = 0;
+		statData.temperatureTimes[tt] = 0;
+		unsigned long loopAttempts = 0, loopsFormed = 0, loopsAccepted = 0, loopSpins = 0;
+
+		// pooled averages of all replicas
+		mpf_class e(0, 1024 * 8), e2(0, 2048 * 8), e4(0, 3072 * 8);
+		std::vector<mpf_class> pt(P, mpf_class(0, 1024 * 8)), pt2(P, mpf_class(0, 2048 * 8)), pt4(P, mpf_class(0, 3072 * 8));
+
+		// spread of the replica averages for the error bars
+		double sc = 0, sc2 = 0, se = 0, se2 = 0, tauE = 0;
+		std::vector<double> sp(P, 0), sp2(P, 0), tauP(P, 0);
+
+		// errors of the single replica are from the binning of its series
+		double cError = 0, eError = 0;
+		std::vector<double> pError(P, 0);
+		int threadId = 0;
+		unsigned seed = 0;
+
+		unsigned k = 0;
+		for (unsigned b = 0; b < blockCount; ++b)
+		{
+			const replicaBlock & block = blocks[tt * blockCount + b];
+			fputs(block.messages.c_str(), out);
+			statData.calculatedSteps[tt] = std::max(statData.calculatedSteps[tt], block.calculatedSteps);
+			statData.heatupSteps[tt] = std::max(statData.heatupSteps[tt], block.heatupSteps);
+			statData.heatupStationary[tt] = statData.heatupStationary[tt] && block.heatupStationary;
+			statData.spinUpdates[tt] += block.spinUpdates;
+			statData.temperatureTimes[tt] += block.time;
+			loopAttempts += block.loopAttempts;
+			loopsFormed += block.loopsFormed;
+			loopsAccepted += block.loopsAccepted;
+			loopSpins += block.loopSpins;
+
+			std::istringstream records(block.records);
+			std::string line;
+			for (; std::getline(records, line); ++k)
 			{
-				ConfigManager::setPBCEnergies(sys);
+				std::istringstream record(line);
+				std::string value;
+				int thread;
+				unsigned replicaSeed;
+				record >> thread >> replicaSeed;
+				auto next = [&](mp_bitcnt_t precision)
+				{
+					record >> value;
+					return mpf_class(value, precision);
+				};
+				// errors may be nan, which is not read by the stream
+				auto nextDouble = [&]()
+				{
+					record >> value;
+					return strtod(value.c_str(), nullptr);
+				};
+				const mpf_class re = next(1024 * 8), re2 = next(2048 * 8), re4 = next(3072 * 8);
+				std::vector<mpf_class> rt, rt2, rt4;
+				for (unsigned i = 0; i < P; ++i)
+				{
+					rt.push_back(next(1024 * 8));
+					rt2.push_back(next(2048 * 8));
+					rt4.push_back(next(3072 * 8));
+				}
+				const double eVarianceError = nextDouble(), eMeanError = nextDouble(), eTau = nextDouble();
+				std::vector<double> rError(P), rTau(P);
+				for (unsigned i = 0; i < P; ++i)
+				{
+					rError[i] = nextDouble();
+					rTau[i] = nextDouble();
+				}
+
+				if (k == 0)
+				{
+					threadId = thread;
+					seed = replicaSeed;
+					cError = eVarianceError;
+					eError = eMeanError;
+					pError = rError;
+				}
+
+				e += re; e2 += re2; e4 += re4;
+				const double c = mpf_class((re2 - (re * re)) / (t * t * N)).get_d();
+				sc += c; sc2 += c * c;
+				se += re.get_d(); se2 += re.get_d() * re.get_d();
+				tauE += eTau / K;
+				for (unsigned i = 0; i < P; ++i)
+				{
+					pt[i] += rt[i];
+					pt2[i] += rt2[i];
+					pt4[i] += rt4[i];
+					const double v = rt[i].get_d();
+					sp[i] += v; sp2[i] += v * v;
+					tauP[i] += rTau[i] / K;
+				}
+
+				// every replica is the comment line, errors are from the binning of its series
+				if (K > 1)
+				{
+					gmp_fprintf(out, "#r%u %e %.30Fe %.30Fe %.30Fe",
+							k, t, mpf_class((re2 - (re * re)) / (t * t * N)).get_mpf_t(), re.get_mpf_t(), re2.get_mpf_t());
+					if(config.isBinder()){
+						gmp_fprintf(out, " %.30Fe", re4.get_mpf_t());
+					}
+					gmp_fprintf(out, " %d %d",
+							thread, replicaSeed);
+					for (unsigned i = 0; i < P; ++i)
+					{
+						gmp_fprintf(out, " %.30Fe %.30Fe",
+								rt[i].get_mpf_t(),
+								rt2[i].get_mpf_t());
+						if(config.isBinder()){
+							gmp_fprintf(out, " %.30Fe",
+								rt4[i].get_mpf_t());
+						}
+					}
+					fprintf(out, " %f", block.time);
+					fprintf(out, " %e %e %e",
+							eVarianceError,
+							eMeanError,
+							eTau);
+					for (unsigned i = 0; i < P; ++i)
+					{
+						fprintf(out, " %e %e", rError[i], rTau[i]);
+					}
+					fprintf(out, "\n");
+				}
 			}
 		}
-		statData.initEnergy = sys.E();
-		for (auto p : sys.parts)
+
+		e /= K; e2 /= K; e4 /= K;
+		for (unsigned i = 0; i < P; ++i)
 		{
-			statData.initEnergy -= p->m.scalar(field);
+			pt[i] /= K; pt2[i] /= K; pt4[i] /= K;
+		}
+
+		mpf_class cT = (e2 - (e * e)) / (t * t * N);
+		statData.refineValues[tt] = cT.get_d();
+		if (refineParameter >= 0)
+			statData.refineValues[tt] = mpf_class((pt2[refineParameter] - pt[refineParameter] * pt[refineParameter]) / t).get_d();
+
+		if (config.getLoops() > 0)
+		{
+			statData.loopsFormed[tt] = double(loopsFormed) / std::max(1ul, loopAttempts);
+			statData.loopsAccepted[tt] = double(loopsAccepted) / std::max(1ul, loopsFormed);
+			statData.loopsLength[tt] = double(loopSpins) / std::max(1ul, loopsAccepted);
 		}
-		statData.lowerEnergy = statData.initEnergy;
-		statData.deltaEnergy = fabs(statData.initEnergy * config.getRestartThreshold());
-	}
+
+		// standard error of the mean of independent replicas
+		auto spreadError = [K](double sum, double sum2)
+		{
+			const double mean = sum / K;
+			return sqrt(std::max(0., sum2 / K - mean * mean) / (K - 1));
+		};
+
+		// pooled line, errors are from the spread between replicas if there are several
+		gmp_fprintf(out, "%e %.30Fe %.30Fe %.30Fe",
+				t, cT.get_mpf_t(), e.get_mpf_t(), e2.get_mpf_t());
+		if(config.isBinder()){
+			gmp_fprintf(out, " %.30Fe", e4.get_mpf_t());
+		}
+		gmp_fprintf(out, " %d %d",
+				threadId, seed);
+		for (unsigned i = 0; i < P; ++i)
+		{
+			gmp_fprintf(out, " %.30Fe %.30Fe",
+					pt[i].get_mpf_t(),
+					pt2[i].get_mpf_t());
+			if(config.isBinder()){
+				gmp_fprintf(out, " %.30Fe",
+					pt4[i].get_mpf_t());
+			}
+		}
+		fprintf(out, " %f", statData.temperatureTimes[tt]);
+		if (K > 1)
+		{
+			fprintf(out, " %e %e %e", spreadError(sc, sc2), spreadError(se, se2), tauE);
+			for (unsigned i = 0; i < P; ++i)
+			{
+				fprintf(out, " %e %e", spreadError(sp[i], sp2[i]), tauP[i]);
+			}
+		}
+		else
+		{
+			fprintf(out, " %e %e %e", cError, eError, tauE);
+			for (unsigned i = 0; i < P; ++i)
+			{
+				fprintf(out, " %e %e", pError[i], tauP[i]);
+			}
+		}
+		fprintf(out, "\n");
+
+		fclose(out);
+		std::string result(outBuffer, outSize);
+		free(outBuffer);
+		return result;
+	};
 
 #pragma omp parallel
 	{
-#pragma omp for
-		for (int tt = 0; tt < config.temperatures.size(); ++tt)
+		while (!refineDone)
 		{
+			// replica blocks of temperatures are taken one by one by the threads of all ranks, as they may stop early when reach the precision
+#pragma omp single
+			coordinator.startTasks(firstTemperature * blockCount, lastTemperature * blockCount);
+			for (int task = coordinator.nextTask(); task >= 0; task = coordinator.nextTask())
 			{
-				statData.temperature_times_start[tt] = std::chrono::steady_clock::now();
-
-				std::vector<std::unique_ptr<CalculationParameter>> calculationParameters;
-				config.getParameters(calculationParameters);
-
-				const double t = config.temperatures[tt];
-				const unsigned trseed = config.getSeed() + tt;
-				default_random_engine generator;
-				generator.seed(trseed);
-				uniform_int_distribution<int> intDistr(0, config.N() - 1); // including right edge
-				uniform_real_distribution<double> doubleDistr(0, 1);	   // right edge is not included
-
-				
-				mpf_class e(0, 1024 * 8);
-				mpf_class e2(0, 2048 * 8);
-				mpf_class e4(0, 3072 * 8);
-
-				/////////// duplicate the system
-				PartArray sys(config.getSystem());
-				if (config.isCSV()){
-					ConfigManager::setCSVEnergies(sys);
-				} else {
-					if (config.isPBC())
+				if (restartToken.isCancelled())
+					continue; // the round is restarted anyway
+				{
+					const int tt = task / blockCount;
+					const unsigned k0 = (task % blockCount) * blockSize; // number of the first replica of the block
+					replicaBlock & block = blocks[task];
+					block.owner = coordinator.rank();
+					block.socket = affinity.currentSocket();
+					const auto time_start = std::chrono::steady_clock::now();
+
+					const double t = config.temperatures[tt];
+					const unsigned K = std::min(blockSize, replicaCount - k0); // replicas of the block
+					uniform_int_distribution<int> intDistr(0, config.N() - 1); // including right edge
+					uniform_real_distribution<double> doubleDistr(0, 1);	   // right edge is not included
+					exponential_distribution<double> exponentialDistr(1);
+
+					unsigned measuredSteps = 0;
+					unsigned heatupSteps = config.getHeatup();
+					bool heatupStationary = false;
+					unsigned long totalSteps = 0;
+					const unsigned measureEvery = config.getMeasureEvery();
+					const bool heatupParameters = config.isAutoHeatup() && config.isAutoHeatupParameters();
+
+					/////////// duplicate the system
+					PartArray sys(config.getSystem());
+					config.prepareSystem(sys);
+					if (!startStates[tt].empty())
 					{
-						ConfigManager::setPBCEnergies(sys);
+						sys.state.fromString(startStates[tt]);
 					}
-				}
 
-				// print neighbours and energies
-				/*sys.E();
-				for (unsigned i=0; i<sys.size(); i++){
-					cout<<i<<": ";
-					unsigned j=0;
-					for (auto p: sys.neighbours[i]){
-						cout<<p->Id()<<"("<<sys.eAt(i,j)<<"), ";
-						++j;
+					const unsigned N = sys.size();
+
+					std::vector<replicaChain> replicas(K);
+					for (unsigned k = 0; k < K; ++k)
+					{
+						replicaChain & r = replicas[k];
+						r.seed = config.getSeed() + tt + (k0 + k) * REPLICA_SEED_STRIDE;
+						r.generator.seed(r.seed);
+						r.state.resize(N);
+						storeState(sys, r.state);
+						config.getParameters(r.calculationParameters);
+						r.deferred.assign(r.calculationParameters.size(), false);
+						r.flipsSinceMeasurement = 0;
+						r.equilibration = std::make_unique<EquilibrationDetector>(
+							1 + (heatupParameters ? r.calculationParameters.size() : 0), HEATUP_WINDOW);
+						r.equilibrated = false;
+						r.precisionBinning = &r.eBinning;
+						r.precisionOfVariance = true;
+						for (auto &cp : r.calculationParameters)
+						{
+							if (cp->parameterId() == config.getPrecisionParameter())
+							{
+								r.precisionBinning = &cp->binning();
+								r.precisionOfVariance = false;
+							}
+						}
+						r.waitingTime = 0;
+						r.nfoldStep = -1;
+						r.lastFlip = -1;
+					}
+					std::vector<double> equilibrationValues(heatupParameters ? config.getParametersCount() + 1 : 1);
+
+					// energy histogram of all replicas, with sums of parameters in every energy bin
+					std::vector<std::string> parameterIds;
+					for (auto &cp : replicas[0].calculationParameters)
+						parameterIds.push_back(cp->parameterId());
+					EnergyHistogram energyHistogram(config.getEnergyHistogram(), t, N, parameterIds);
+					std::vector<double> histogramValues(parameterIds.size());
+
+					// strong bonds do not depend on the state, so all replicas use the same loop builder
+					std::unique_ptr<LoopUpdate> loopUpdate;
+					if (config.getLoops() > 0)
+					{
+						loopUpdate = std::make_unique<LoopUpdate>(sys, config.getLoopThreshold());
 					}
-					cout<<endl;
-				}*/
 
-				ofstream saveShortFile;
+					// print neighbours and energies
+					/*sys.E();
+					for (unsigned i=0; i<sys.size(); i++){
+						cout<<i<<": ";
+						unsigned j=0;
+						for (auto p: sys.neighbours[i]){
+							cout<<p->Id()<<"("<<sys.eAt(i,j)<<"), ";
+							++j;
+						}
+						cout<<endl;
+					}*/
 
-				const unsigned N = sys.size();
+					ofstream saveShortFile;
 
-				bool swapRes;
-				unsigned swapNum;
-				const Vect field = config.getField();
-				double eOld;
+					unsigned swapNum;
+					const Vect field = config.getField();
 
-				double dE, p, randNum;
+					double dE, p, randNum;
 
-				double mxOld;
-				double myOld;
+					bool acceptSweep;
 
-				bool acceptSweep;
+					replicaChain * rep = &replicas[0]; // the chain which state is loaded to the system
 
-				// phase=0 is the heatup, phase=1 is calculate
-				for (unsigned phase = 0; phase <= 1; ++phase)
-				{
+					// validation is made on random steps, so the drift can not fit between the checks,
+					// with own random stream, so the chains do not depend on it
+					default_random_engine validationGenerator(config.getSeed() + tt);
+					geometric_distribution<unsigned long> validationGap(config.getValidateEvery() > 0 ? 1. / config.getValidateEvery() : 1.);
+					unsigned long nextValidation = 1 + validationGap(validationGenerator);
+					double validationTime = 0;
 
-					// full recalculte energy
-					eOld = sys.E();
-					// add external field
-					for (auto p : sys.parts)
-					{
-						eOld -= p->m.scalar(field);
-					}
+					// output of the block is printed together with the results of the temperature
+					char * outBuffer = nullptr;
+					size_t outSize = 0;
+					FILE * out = open_memstream(&outBuffer, &outSize);
+					const int threadId = coordinator.rank() * omp_get_num_threads() + omp_get_thread_num();
 
-					if (phase == 1)
+					// phase=0 is the heatup, phase=1 is calculate
+					for (unsigned phase = 0; phase <= 1; ++phase)
 					{
-						for (auto &cp : calculationParameters)
+
+						// parameters are tracked on calculate, and on heatup if they are checked for stationarity
+						const bool trackParameters = (phase == 1 || heatupParameters);
+
+						// apply the accepted flip of spin id and follow it by energy and parameters
+						auto acceptFlip = [&](unsigned id, double flipE)
 						{
-							cp->init(&sys); // attach the system and calculate the init value
+							sys.parts[id]->rotate(false);
+							rep->eOld += flipE;
+							rep->lastFlip = id;
+
+							if (trackParameters)
+							{
+								++rep->flipsSinceMeasurement;
+								for (unsigned s = subscriptionOffsets[id]; s < subscriptionOffsets[id + 1]; ++s)
+								{
+									const unsigned i = subscriptions[s];
+									if (!rep->deferred[i])
+										rep->calculationParameters[i]->iterate(id);
+								}
+							}
+
+							if (config.isRestart() && rep->eOld < lowerEnergyRecord.value() && lowerEnergyRecord.improve(rep->eOld)) // if found lower energy
+							{
+								std::string state = sys.state.toString();
+#pragma omp critical(lowerEnergy)
+								{
+									// other chain could store the even lower record meanwhile
+									if (rep->eOld < statData.lowerEnergy)
+									{
+										statData.lowerEnergy = rep->eOld;
+										statData.lowerEnergyState.swap(state);
+										statData.temperatureOfLowerEnergy = tt;
+									}
+								}
+								restartToken.cancel();
+								coordinator.reportLowerEnergy(rep->eOld);
+							}
+						};
+
+						for (auto &r : replicas)
+						{
+							loadState(sys, r.state);
+							// full recalculte energy
+							r.eOld = config.energy(sys);
+							if (trackParameters)
+							{
+								for (auto &cp : r.calculationParameters)
+								{
+									cp->init(&sys); // attach the system and calculate the init value
+								}
+							}
+							r.flipsSinceMeasurement = 0;
 						}
 
-						if (config.getSaveShort()){
-							saveShortFile.open(config.getSaveShortFileName(tt));
-							saveShortFile<<"# t = "<<t<<endl;
-							saveShortFile<<"# states below are after "<<config.getHeatup()<<" heatup MC steps"<<endl;
-							saveShortFile<<"# legend: "<<endl;
-							saveShortFile<<"# <step>\t<configuration>"<<endl;
+						if (phase == 1)
+						{
+							if (config.isAutoHeatup())
+							{
+								fprintf(out, "# T%d=%e", tt, t);
+								if (blockCount > 1)
+									fprintf(out, ", replicas %u-%u", k0, k0 + K - 1);
+								fprintf(out, ": heatup finished after %u steps, %s\n", heatupSteps,
+									heatupStationary ? "stationary" : "maximum reached, not stationary");
+							}
+
+							// states are saved for the first replica only
+							if (config.getSaveShort() && k0 == 0){
+								saveShortFile.open(config.getSaveShortFileName(tt));
+								saveShortFile<<"# t = "<<t<<endl;
+								saveShortFile<<"# states below are after "<<heatupSteps<<" heatup MC steps";
+								if (config.isAutoHeatup() && !heatupStationary)
+									saveShortFile<<", heatup reached the maximum before the series became stationary";
+								saveShortFile<<endl;
+								saveShortFile<<"# legend: "<<endl;
+								saveShortFile<<"# <step>\t<configuration>"<<endl;
+							}
 						}
-					}
 
-					unsigned calculateSteps;
-					if (phase == 0)
-						calculateSteps = config.getHeatup();
-					else
-						calculateSteps = config.getCalculate();
+						unsigned calculateSteps;
+						if (phase == 0)
+							calculateSteps = config.getHeatup();
+						else
+							calculateSteps = config.getCalculate();
 
-					for (unsigned step = 0; step < calculateSteps; ++step)
-					{
-						// full recalculte energy every to avoid FP error collection
-						if (step != 0 && step % FULL_REFRESH_EVERY == 0)
+						for (unsigned step = 0; step < calculateSteps; ++step)
 						{
-							eOld = sys.E();
-							// add external field
-							for (auto p : sys.parts)
+							const bool refresh = (step != 0 && step % FULL_REFRESH_EVERY == 0);
+							// energy and parameters are tracked without drift, the full recalculation is only the optional check,
+							// skipped while it takes more than the budget of the running time
+							bool validate = false;
+							if (config.getValidateEvery() > 0 && totalSteps >= nextValidation)
 							{
-								eOld -= p->m.scalar(field);
+								nextValidation = totalSteps + 1 + validationGap(validationGenerator);
+								const double elapsed = std::chrono::duration<double>(
+									std::chrono::steady_clock::now() - time_start).count();
+								validate = (validationTime <= config.getValidateBudget() * elapsed);
 							}
-
-							if (statData.foundLowerEnergy){
+							// other ranks are asked rarely, as it is the remote access
+							if (refresh && config.isRestart() &&
+								coordinator.lowerEnergyReported(statData.initEnergy - statData.deltaEnergy)){
+								restartToken.cancel();
+							}
+							if (restartToken.isCancelled()){
 								//cancel the calculations
 								phase = 1; //force go to the phase
 								break; //break up the main for loop
 							}
-						}
 
-						for (unsigned sstep = 0; sstep < N; ++sstep)
-						{
+							// measure the observables only every measureEvery steps
+							const bool measure = ((step + 1) % measureEvery == 0);
+							unsigned equilibratedCount = 0;
 
-							dE = 0;
-							swapNum = intDistr(generator);
-							Part *partA = sys.getById(swapNum);
+							// replicas make the step one after another on the same system
+							for (unsigned k = 0; k < K; ++k)
+							{
+								rep = &replicas[k];
+								replicaChain & r = *rep;
+								loadState(sys, r.state);
 
-							{ // get dE
-								unsigned j = 0;
+								if (refresh && r.nfold)
+								{
+									r.nfold->rebuild();
+								}
 
-								if (sys.interactionRange() != 0.0)
+								if (!r.nfold)
 								{
-									for (Part *neigh : sys.neighbours[swapNum])
+									unsigned acceptedFlips = 0;
+									for (unsigned sstep = 0; sstep < N; ++sstep)
 									{
-										if (neigh->state == partA->state) // assume it is rotated, inverse state in mind
-											dE -= 2. * sys.eAt(swapNum, j);
+
+										swapNum = intDistr(r.generator);
+										dE = deltaEnergy(sys, swapNum, field);
+
+										acceptSweep = false;
+										if (dE < 0 || t == 0)
+										{
+											acceptSweep = true;
+										}
 										else
-											dE += 2. * sys.eAt(swapNum, j);
-										++j;
+										{
+											p = exp(-dE / t);
+											randNum = doubleDistr(r.generator);
+											if (randNum <= p)
+											{
+												acceptSweep = true;
+											}
+										}
+
+										if (acceptSweep)
+										{
+											acceptFlip(swapNum, dE);
+											++acceptedFlips;
+										}
+									}
+
+									// most of the trials are rejected, switch to the rejection-free dynamics
+									if (t > 0 && double(acceptedFlips) / N < config.getNFold())
+									{
+										r.nfold = std::make_unique<NFoldWay>(sys, field, t);
+										r.waitingTime = exponentialDistr(r.generator) / r.nfold->totalRate();
+										r.nfoldStep = totalSteps;
 									}
 								}
 								else
 								{
-									for (Part *neigh : sys.parts)
+									// flips with exponential waiting times until the end of the MC step,
+									// so the state at the end of the step is sampled with its time weight
+									double stepTime = 1;
+									while (r.waitingTime <= stepTime)
 									{
-										if (partA != neigh)
+										stepTime -= r.waitingTime;
+										swapNum = r.nfold->choose(doubleDistr(r.generator));
+										acceptFlip(swapNum, r.nfold->dE(swapNum));
+										r.nfold->flipped(swapNum);
+										r.waitingTime = exponentialDistr(r.generator) / r.nfold->totalRate();
+									}
+									r.waitingTime -= stepTime;
+								}
+
+								// non-local loop moves between the sweeps
+								for (unsigned l = 0; l < config.getLoops(); ++l)
+								{
+									double loopE;
+									if (loopUpdate->attempt(t, field, r.generator, loopE))
+									{
+										r.eOld += loopE;
+										r.lastFlip = loopUpdate->loop().back();
+										if (r.nfold)
+										{
+											// the rates are updated incrementally, so the loop spins are flipped again one by one
+											const std::vector<unsigned> & loop = loopUpdate->loop();
+											for (unsigned id : loop)
+												sys.parts[id]->rotate(false);
+											for (unsigned id : loop)
+											{
+												sys.parts[id]->rotate(false);
+												r.nfold->flipped(id);
+											}
+										}
+										if (trackParameters)
 										{
-											if (neigh->state == partA->state)
-												dE -= 2. * sys.eAt(swapNum, j);
-											else
-												dE += 2. * sys.eAt(swapNum, j);
-											++j;
+											// parameters follow the flips of loop spins one by one
+											const std::vector<unsigned> & loop = loopUpdate->loop();
+											for (unsigned id : loop)
+												sys.parts[id]->rotate(false);
+											for (unsigned id : loop)
+											{
+												sys.parts[id]->rotate(false);
+												++r.flipsSinceMeasurement;
+												for (unsigned s = subscriptionOffsets[id]; s < subscriptionOffsets[id + 1]; ++s)
+												{
+													const unsigned i = subscriptions[s];
+													if (!r.deferred[i])
+														r.calculationParameters[i]->iterate(id);
+												}
+											}
 										}
 									}
 								}
 
-								dE += 2 * partA->m.scalar(field);
-							}
-
-							acceptSweep = false;
-							if (dE < 0 || t == 0)
-							{
-								acceptSweep = true;
-							}
-							else
-							{
-								p = exp(-dE / t);
-								randNum = doubleDistr(generator);
-								if (randNum <= p)
+								// the tracked values are compared with the full recalculation and replaced by it
+								if (validate)
 								{
-									acceptSweep = true;
+									const auto validationStart = std::chrono::steady_clock::now();
+									const double eExact = config.energy(sys);
+									if (fabs(eExact - r.eOld) > config.getValidateTolerance() * std::max(1., fabs(eExact)))
+									{
+										cerr << "# (validate) T" << tt << " replica " << k0 + k << " step " << totalSteps << ", last flip of spin " << r.lastFlip
+											<< ": energy tracked " << double(r.eOld) << ", actual " << eExact << endl;
+									}
+									r.eOld = eExact;
+									if (trackParameters)
+									{
+										for (unsigned i = 0; i < r.calculationParameters.size(); ++i)
+										{
+											CalculationParameter & cp = *r.calculationParameters[i];
+											if (r.deferred[i])
+												continue; // it is recalculated on measurement anyway
+											const double difference = cp.mismatch();
+											if (difference > config.getValidateTolerance())
+											{
+												cerr << "# (validate) T" << tt << " replica " << k0 + k << " step " << totalSteps << ", last flip of spin " << r.lastFlip
+													<< ": parameter " << cp.parameterId() << " differs by " << difference << " of its total" << endl;
+											}
+											cp.update();
+										}
+									}
+									validationTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - validationStart).count();
 								}
-							}
 
-							if (acceptSweep)
-							{
-								sys.parts[swapNum]->rotate(false);
-								eOld += dE;
-
-								if (phase == 1)
+								if (measure && trackParameters)
 								{
-									for (auto &cp : calculationParameters)
+									for (unsigned i = 0; i < r.calculationParameters.size(); ++i)
 									{
-										cp->iterate(partA->Id());
+										if (r.deferred[i])
+											r.calculationParameters[i]->update();
+										// recalculate from state next time if it is cheaper than iterate all the flips
+										r.deferred[i] = r.calculationParameters[i]->updateCost() <
+											r.flipsSinceMeasurement * r.calculationParameters[i]->iterateCost();
 									}
+									r.flipsSinceMeasurement = 0;
 								}
 
-								if (config.debug)
+								// check if the heatup of the replica is done
+								if (measure && phase == 0 && config.isAutoHeatup())
 								{
-									// recalc energy
-									double eTmp = sys.E();
-
-									// add external field
-									for (auto pt : sys.parts)
+									if (!r.equilibrated)
 									{
-										eTmp -= pt->m.scalar(field);
+										equilibrationValues[0] = r.eOld;
+										if (heatupParameters)
+										{
+											for (unsigned i = 0; i < r.calculationParameters.size(); ++i)
+												equilibrationValues[i + 1] = r.calculationParameters[i]->value();
+										}
+										r.equilibrated = r.equilibration->add(equilibrationValues);
+									}
+									if (r.equilibrated)
+										++equilibratedCount;
+								}
+
+								// update thermodynamic averages (porosyenok ;)
+								if (phase == 1)
+								{
+									// states are saved for the first replica only
+									if (k0 + k == 0 && config.getSaveStates()>0 && step % config.getSaveStates() == 0){
+										sys.save( config.getSaveStateFileName(tt,step) );
+									}
+									if (k0 + k == 0 && config.getSaveShort()>0 && step % config.getSaveShort() == 0){
+										saveShortFile<<step<<"\t"<<sys.state.toString()<<endl;
 									}
 
-									if (fabs(eTmp - eOld) > 0.00001)
+									if (measure)
 									{
-										cerr << "# (dbg main#" << phase << ") energy is different. iterative: " << eOld << "; actual: " << eTmp << endl;
+										const double eNow = r.eOld;
+										r.e += eNow;
+										r.e2 += eNow * eNow;
+										r.eBinning.add(r.eOld);
+										if(config.isBinder()){
+											r.e4 += r.e2 * r.e2;
+										}
+										for (auto &cp : r.calculationParameters)
+										{
+											cp->incrementTotal();
+										}
+										if (config.getEnergyHistogram() > 0)
+										{
+											for (unsigned i = 0; i < r.calculationParameters.size(); ++i)
+												histogramValues[i] = r.calculationParameters[i]->value();
+											energyHistogram.add(r.eOld, histogramValues);
+										}
 									}
 								}
 
-								
-								if (config.isRestart() && (eOld - statData.lowerEnergy) < -statData.deltaEnergy) // if found lower energy
+								storeState(sys, r.state);
+							}
+							++totalSteps;
+
+							// the heatup is done when all the replicas are stationary
+							if (measure && phase == 0 && config.isAutoHeatup() && equilibratedCount == K)
+							{
+								heatupSteps = step + 1;
+								heatupStationary = true;
+								break;
+							}
+
+							if (phase == 1 && measure)
+							{
+								++measuredSteps;
+
+								// stop when the desired precision is reached by all replicas
+								if (config.getPrecision() > 0 &&
+									measuredSteps >= PRECISION_MIN_STEPS &&
+									measuredSteps % PRECISION_CHECK_EVERY == 0)
 								{
-#pragma omp critical
+									bool precise = true;
+									for (auto &r : replicas)
 									{
-										statData.foundLowerEnergy = 1;
-										statData.lowerEnergy = eOld;
-										statData.lowerEnergyState = sys.state.toString();
-										statData.temperatureOfLowerEnergy = tt;
+										double relError;
+										if (r.precisionOfVariance)
+											relError = r.precisionBinning->varianceError() / fabs(r.precisionBinning->variance());
+										else
+											relError = r.precisionBinning->meanError() / fabs(r.precisionBinning->mean());
+										if (!(relError < config.getPrecision()))
+											precise = false;
 									}
+									if (precise)
+										break;
 								}
 							}
 						}
+					}
 
-						// update thermodynamic averages (porosyenok ;)
-						if (phase == 1)
+					if (config.getSaveShort() && saveShortFile.is_open()){
+						saveShortFile.close();
+					}
+
+					fclose(out);
+					block.messages.assign(outBuffer, outSize);
+					free(outBuffer);
+
+					if (!restartToken.isCancelled()) {
+						// averages and errors of every replica, the pooled statistics are reduced from all blocks
+						char * recordsBuffer = nullptr;
+						size_t recordsSize = 0;
+						FILE * records = open_memstream(&recordsBuffer, &recordsSize);
+						for (auto &r : replicas)
 						{
-							e += eOld;
-							e2 += eOld * eOld;
+							r.e /= measuredSteps;
+							r.e2 /= measuredSteps;
 							if(config.isBinder()){
-								e4 += e2 * e2;
+								r.e4 /= measuredSteps;
+							}
+							gmp_fprintf(records, "%d %u %.60Fe %.60Fe %.60Fe",
+									threadId, r.seed, r.e.get_mpf_t(), r.e2.get_mpf_t(), r.e4.get_mpf_t());
+							for (auto &cp : r.calculationParameters)
+							{
+								gmp_fprintf(records, " %.60Fe %.60Fe %.60Fe",
+										cp->getTotal(measuredSteps).get_mpf_t(),
+										cp->getTotal2(measuredSteps).get_mpf_t(),
+										cp->getTotal4(measuredSteps).get_mpf_t());
 							}
-							for (auto &cp : calculationParameters)
+							fprintf(records, " %.17e %.17e %.17e",
+									r.eBinning.varianceError() / (t * t * N),
+									r.eBinning.meanError(),
+									r.eBinning.tau());
+							for (auto &cp : r.calculationParameters)
 							{
-								cp->incrementTotal();
+								fprintf(records, " %.17e %.17e", cp->binning().meanError(), cp->binning().tau());
 							}
+							fprintf(records, "\n");
+						}
+						fclose(records);
+						block.records.assign(recordsBuffer, recordsSize);
+						free(recordsBuffer);
+
+						loadState(sys, replicas[0].state);
+						block.finalState = sys.state.toString();
+						block.finalEnergy = replicas[0].eOld;
+						block.calculatedSteps = measuredSteps;
+						block.heatupSteps = heatupSteps;
+						block.heatupStationary = heatupStationary;
+						block.nfoldStep = replicas[0].nfoldStep;
+						block.spinUpdates = double(totalSteps) * K * N;
+						block.loopAttempts = block.loopsFormed = block.loopsAccepted = block.loopSpins = 0;
+						if (loopUpdate)
+						{
+							block.loopAttempts = loopUpdate->attempts();
+							block.loopsFormed = loopUpdate->formed();
+							block.loopsAccepted = loopUpdate->accepted();
+							block.loopSpins = loopUpdate->flippedSpins();
+						}
+						if (config.getEnergyHistogram() > 0)
+							energyHistogram.save(config.getHistogramFileName(tt));
+						block.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_start).count();
 
-							if (config.getSaveStates()>0 && step % config.getSaveStates() == 0){
-								sys.save( config.getSaveStateFileName(tt,step) );
+						// histograms and other files are saved for the first replica
+						if (k0 == 0)
+						{
+#pragma omp critical
+							for (auto &cp : replicas[0].calculationParameters)
+							{
+								cp->save(tt);
 							}
-							if (config.getSaveShort()>0 && step % config.getSaveShort() == 0){
-								saveShortFile<<step<<"\t"<<sys.state.toString()<<endl;
+						}
+
+						// with one rank the temperature is printed when its last block is done,
+						// otherwise the blocks are shared and printed by the root rank after the round
+						if (coordinator.size() == 1)
+						{
+#pragma omp critical
+							if (++blocksDone[tt] == blockCount)
+							{
+								fputs(reduceTemperature(tt).c_str(), stdout);
+								fflush(stdout);
 							}
 						}
 					}
 				}
+			}
+#pragma omp barrier
 
-				if (config.getSaveShort() && saveShortFile.is_open()){
-					saveShortFile.close();
-				}
-
-				if (!statData.foundLowerEnergy) {
-					e /= config.getCalculate();
-					e2 /= config.getCalculate();
-					if(config.isBinder()){
-						e4 /= config.getCalculate();
+#pragma omp single
+			{
+				statData.foundLowerEnergy = restartToken.isCancelled();
+				if (coordinator.size() > 1)
+				{
+					shareResults(coordinator, statData, blocks, firstTemperature * blockCount, lastTemperature * blockCount);
+					for (int tt = firstTemperature; tt < lastTemperature && !statData.foundLowerEnergy; ++tt)
+					{
+						const std::string result = reduceTemperature(tt);
+						if (coordinator.isRoot())
+							fputs(result.c_str(), stdout);
 					}
+					fflush(stdout);
+				}
 
-					mpf_class cT = (e2 - (e * e)) / (t * t * N);
-
-					statData.finalStates[tt] = sys.state.toString();
-					statData.finalEnergies[tt] = eOld;
-					statData.temperature_times_end[tt] = std::chrono::steady_clock::now();
-
-	#pragma omp critical
+				refineDone = true;
+				if (config.getRefine() > 0 && !statData.foundLowerEnergy)
+				{
+					std::vector<double> added = refineTemperatures(config.temperatures, statData.refineValues, config.getRefine());
+					firstTemperature = config.temperatures.size();
+					for (double t : added)
 					{
-						gmp_printf("%e %.30Fe %.30Fe %.30Fe",
-								t, cT.get_mpf_t(), e.get_mpf_t(), e2.get_mpf_t());
-						if(config.isBinder()){
-							gmp_printf(" %.30Fe", e4.get_mpf_t());
-						}
-						gmp_printf(" %d %d",
-								omp_get_thread_num(), trseed);
-						for (auto &cp : calculationParameters)
+						// the new temperature starts from the equilibrated state of the lower neighbour
+						int neighbour = -1;
+						for (int tt = 0; tt < firstTemperature; ++tt)
 						{
-							gmp_printf(" %.30Fe %.30Fe",
-									cp->getTotal(config.getCalculate()).get_mpf_t(),
-									cp->getTotal2(config.getCalculate()).get_mpf_t());
-							if(config.isBinder()){
-								gmp_printf(" %.30Fe",
-									cp->getTotal4(config.getCalculate()).get_mpf_t());
-							}
+							if (config.temperatures[tt] < t && (neighbour < 0 || config.temperatures[tt] > config.temperatures[neighbour]))
+								neighbour = tt;
 						}
-						auto rtime = std::chrono::duration_cast<std::chrono::milliseconds>(statData.temperature_times_end[tt] - statData.temperature_times_start[tt]).count();
-						printf(" %f", rtime / 1000.);
-						printf("\n");
+						config.temperatures.push_back(t);
+						startStates.push_back(neighbour >= 0 ? statData.finalStates[neighbour] : "");
+					}
+					lastTemperature = config.temperatures.size();
+					resizeStatistics(lastTemperature);
+					if (!added.empty())
+					{
+						refineDone = false;
+					}
+					if (!added.empty() && coordinator.isRoot())
+					{
+						printf("# refine: %zu temperatures added between %e and %e\n",
+							added.size(),
+							*std::min_element(added.begin(), added.end()),
+							*std::max_element(added.begin(), added.end()));
 						fflush(stdout);
-						for (auto &cp : calculationParameters)
-						{
-							cp->save(tt);
-						}
 					}
 				}
 			}
@@ -416,30 +1140,102 @@ int main(int argc, char *argv[])
 {
 	auto time_start = std::chrono::steady_clock::now();
 
-	auto config = readParameters(argc,argv);
+	MpiCoordinator coordinator(argc, argv);
+
+	auto config = readParameters(argc,argv,coordinator);
 	if (!config){
 		return 0;
 	}
 
+	// threads keep their cpus in all the parallel regions below
+	ThreadAffinity affinity;
+	if (config->getAffinity() != "none"){
+#pragma omp parallel
+		affinity.pinThreads(config->getAffinity(), coordinator.localRank());
+	}
+
+	if (config->isDomains()){
+		std::string lowestState;
+		double eLowest = domainMonteCarlo(*config, coordinator, lowestState);
+		if (!coordinator.isRoot()){
+			return 0;
+		}
+		auto time_end = std::chrono::steady_clock::now();
+		int64_t time_total = std::chrono::duration_cast<std::chrono::milliseconds>(time_end - time_start).count();
+		printf("###########  end of calculations #############\n");
+		printf("# total time: %fs\n", time_total / 1000.);
+		printf("# lowest energy found: %g, state: %s\n", eLowest, lowestState.c_str());
+		if (!config->getNewGSFilename().empty() && !lowestState.empty()){
+			config->applyState(lowestState);
+			config->saveSystem(config->getNewGSFilename());
+			printf("# system with found lowest energy is saved to file %s\n",config->getNewGSFilename().c_str());
+		}
+		return 0;
+	}
+
+	// other algorithms are not distributed, they run on the root rank only
+	if (!coordinator.isRoot() && (config->getPopulation() > 0 || config->getMultiSpin() > 0 || config->getWangLandau() > 0)){
+		return 0;
+	}
+
+	if (config->getPopulation() > 0){
+		std::string lowestState;
+		double eLowest = populationAnnealing(*config, lowestState);
+		auto time_end = std::chrono::steady_clock::now();
+		int64_t time_total = std::chrono::duration_cast<std::chrono::milliseconds>(time_end - time_start).count();
+		printf("###########  end of calculations #############\n");
+		printf("# total time: %fs\n", time_total / 1000.);
+		printf("# lowest energy found: %g, state: %s\n", eLowest, lowestState.c_str());
+		if (!config->getNewGSFilename().empty()){
+			config->applyState(lowestState);
+			config->saveSystem(config->getNewGSFilename());
+			printf("# system with found lowest energy is saved to file %s\n",config->getNewGSFilename().c_str());
+		}
+		return 0;
+	}
+
+	if (config->getMultiSpin() > 0 || config->getWangLandau() > 0){
+		std::string lowestState;
+		double eLowest = (config->getMultiSpin() > 0) ?
+			multiSpinMonteCarlo(*config, lowestState) :
+			wangLandau(*config, lowestState);
+		auto time_end = std::chrono::steady_clock::now();
+		int64_t time_total = std::chrono::duration_cast<std::chrono::milliseconds>(time_end - time_start).count();
+		printf("###########  end of calculations #############\n");
+		printf("# total time: %fs\n", time_total / 1000.);
+		printf("# lowest energy found: %g, state: %s\n", eLowest, lowestState.c_str());
+		if (!config->getNewGSFilename().empty() && !lowestState.empty()){
+			config->applyState(lowestState);
+			config->saveSystem(config->getNewGSFilename());
+			printf("# system with found lowest energy is saved to file %s\n",config->getNewGSFilename().c_str());
+		}
+		return 0;
+	}
+
 	bool programRestarted = false;
 	monteCarloStatistics statData;
 	std::string finalState = config->getSystem().state.toString();
 	do {
-		statData = montecarlo(*config); // запуск самих вычислений
+		statData = montecarlo(*config, coordinator, affinity); // запуск самих вычислений
 		if (statData.foundLowerEnergy){
 			config->applyState(statData.lowerEnergyState);
-			printf("# -- restart MC: found lower energy %g < %g, at T%d=%g new state: %s\n",
-			   statData.lowerEnergy,
-			   statData.initEnergy,
-			   statData.temperatureOfLowerEnergy,
-			   config->temperatures[statData.temperatureOfLowerEnergy],
-			   statData.lowerEnergyState.c_str());
+			if (coordinator.isRoot()){
+				printf("# -- restart MC: found lower energy %g < %g, at T%d=%g new state: %s\n",
+				   statData.lowerEnergy,
+				   statData.initEnergy,
+				   statData.temperatureOfLowerEnergy,
+				   config->temperatures[statData.temperatureOfLowerEnergy],
+				   statData.lowerEnergyState.c_str());
+			}
 			programRestarted = true;
 			finalState = xorstr(finalState,statData.lowerEnergyState);
 		}
 	} while(statData.foundLowerEnergy);
 
-	
+	// all the results are already gathered on the root rank
+	if (!coordinator.isRoot()){
+		return 0;
+	}
 
 	auto time_end = std::chrono::steady_clock::now();
 
@@ -450,20 +1246,55 @@ int main(int argc, char *argv[])
 	printf("###########     final notes:     #############\n");
 	for (int tt = 0; tt < config->temperatures.size(); ++tt)
 	{
-		auto rtime = std::chrono::duration_cast<std::chrono::milliseconds>(statData.temperature_times_end[tt] - statData.temperature_times_start[tt]).count();
-		printf("#%d, time=%fs, T=%e, E=%e, final state: %s\n",
+		const int64_t rtime = statData.temperatureTimes[tt] * 1000;
+		printf("#%d, time=%fs, heatup=%u, steps=%u, T=%e, E=%e, ",
 			   tt,
 			   rtime / 1000.,
+			   statData.heatupSteps[tt],
+			   statData.calculatedSteps[tt],
 			   config->temperatures[tt],
-			   statData.finalEnergies[tt],
-			   statData.finalStates[tt].c_str());
+			   statData.finalEnergies[tt]);
+		if (config->getLoops() > 0)
+		{
+			printf("loops formed=%.2f%%, accepted=%.2f%%, avg. length=%.1f, ",
+				statData.loopsFormed[tt] * 100,
+				statData.loopsAccepted[tt] * 100,
+				statData.loopsLength[tt]);
+		}
+		if (config->isAutoHeatup() && !statData.heatupStationary[tt])
+		{
+			printf("heatup stopped at maximum, not stationary, ");
+		}
+		if (statData.nfoldSteps[tt] >= 0)
+		{
+			printf("n-fold way from step %ld, ", statData.nfoldSteps[tt]);
+		}
+		printf("final state: %s\n", statData.finalStates[tt].c_str());
 		time_proc_total += rtime;
 	}
 
 	printf("#\n");
+
+	// throughput of one thread on every socket, it is lower on the sockets with remote memory or shared cores
+	std::vector<double> socketUpdates(affinity.socketCount(), 0), socketTimes(affinity.socketCount(), 0);
+	std::vector<unsigned> socketTemperatures(affinity.socketCount(), 0);
+	for (int tt = 0; tt < config->temperatures.size(); ++tt)
+	{
+		const unsigned s = std::min<unsigned>(statData.sockets[tt], affinity.socketCount() - 1);
+		socketUpdates[s] += statData.spinUpdates[tt];
+		socketTimes[s] += statData.temperatureTimes[tt];
+		++socketTemperatures[s];
+	}
+	for (unsigned s = 0; s < affinity.socketCount(); ++s)
+	{
+		if (socketTemperatures[s] > 0)
+			printf("# socket %u: %u temperatures, %e spin updates/s per thread\n",
+				s, socketTemperatures[s], socketUpdates[s] / socketTimes[s]);
+	}
+
 	int64_t time_total = std::chrono::duration_cast<std::chrono::milliseconds>(time_end - time_start).count();
 	double speedup = double(time_proc_total) / time_total;
-	printf("# total time: %fs, speedup: %f%%, efficiency: %f%%\n", time_total / 1000., speedup * 100, speedup / config->threadCount * 100);
+	printf("# total time: %fs, speedup: %f%%, efficiency: %f%%\n", time_total / 1000., speedup * 100, speedup / (config->threadCount * config->rankCount) * 100);
 
 	if (programRestarted){
 		printf("\n##### Warning! The program was restarted because it found the lower energy.\n");
@@ -28,34 +28,56 @@ inline void trim(std::string &s) {
 
 
 /*================ outer functions ===================*/
-vector < vector < double > > readCSV(string filename){
+SparseTable readCSV(string filename){
     char delimiter = ';';
 
     ifstream file(filename);
     if (!file.is_open()) throw(string("Error reading csv file ") + filename);
 
-    vector < vector < double > > result;
+    SparseTable result;
 
     int linenum = 0;
     int linecount = -1;
+    bool sparse = false; // the file starts with "# sparse N" and has lines i;j;J, one per bond
     do {
         string line;
         getline(file,line);
         trim(line);
+        if (linecount==-1 && line.compare(0,8,"# sparse")==0){
+            sparse = true;
+            linecount = stoi(line.substr(8));
+            result.resize(linecount);
+            continue;
+        }
         if (line.length()<2 || line[0]=='#') continue;
 
+        if (sparse){
+            const size_t p1 = line.find(delimiter);
+            const size_t p2 = (p1 != std::string::npos) ? line.find(delimiter, p1 + 1) : std::string::npos;
+            if (p2 == std::string::npos) throw(string("Bond line should be i;j;J in file ") + filename);
+            const int i = stoi(line.substr(0, p1));
+            const int j = stoi(line.substr(p1 + 1, p2 - p1 - 1));
+            if (i < 0 || j < 0 || i >= linecount || j >= linecount) throw(string("Spin number out of range in file ") + filename);
+            const double dval = stod(line.substr(p2 + 1));
+            if (dval != 0.0 && i != j){
+                result[i].push_back(make_pair(unsigned(j), dval));
+                result[j].push_back(make_pair(unsigned(i), dval));
+            }
+            continue;
+        }
+
         if (linecount==-1){ //read count of columns from the first line
             linecount = count(line.begin(), line.end(), delimiter)+1;
             result.resize(linecount);
-            for (int i = 0; i < linecount; ++i)
-                result[i].resize(linecount);
         }
-        
+        if (linenum>=linecount) throw(string("Too much lines in file ") + filename);
+
         int colnum = 0;
         size_t pos = 0;
         std::string sval;
         double dval;
         do {
+            if (colnum>=linecount) throw(string("Too much columns in file ") + filename);
             pos = line.find(delimiter);
             sval = (pos != std::string::npos) ? line.substr(0, pos) : line;
             if (sval.length()>0)
@@ -63,13 +85,24 @@ vector < vector < double > > readCSV(string filename){
             else
                 dval = 0;
             line.erase(0, pos + 1);
-            result[linenum][colnum] = dval;
+            if (dval != 0.0)
+                result[linenum].push_back(make_pair(unsigned(colnum), dval));
             colnum++;
-            if (colnum>linecount) throw(string("Too much columns in file ") + filename);
         } while (pos != std::string::npos);
         linenum++;
-        if (linenum>linecount) throw(string("Too much lines in file ") + filename);
     } while (!file.eof());
 
+    // bonds of the sparse format come in any order, keep the rows sorted for the lookup
+    // a bond listed twice keeps its last value, as in the dense table
+    for (auto & row : result){
+        stable_sort(row.begin(), row.end(), [](const pair<unsigned,double> & x, const pair<unsigned,double> & y){ return x.first < y.first; });
+        auto last = row.begin();
+        for (auto it = row.begin(); it != row.end(); ++it){
+            if (last != it && last->first == it->first) *last = *it;
+            else if (it != row.begin()) *(++last) = *it;
+        }
+        if (!row.empty()) row.erase(last + 1, row.end());
+    }
+
     return result;
 }
\ No newline at end of file
@@ -6,9 +6,96 @@
 #include <fstream>
 #include <vector>
 #include <algorithm>
+#include <cmath>
+#include "PartArray.h"
 
 using namespace std;
 
-vector < vector < double > > readCSV(string filename);
+/**
+ * @brief nonzero energies of a csv system, row i holds pairs (j, J_ij) sorted by j
+ */
+typedef vector < vector < pair < unsigned, double > > > SparseTable;
+
+SparseTable readCSV(string filename);
+
+/**
+ * @brief energy change after flipping the spin id in external field
+ */
+inline double deltaEnergy(PartArray & sys, unsigned id, const Vect & field)
+{
+    double dE = 0;
+    unsigned j = 0;
+    Part *partA = sys.parts[id];
+
+    if (sys.interactionRange() != 0.0)
+    {
+        for (Part *neigh : sys.neighbours[id])
+        {
+            if (neigh->state == partA->state) // assume it is rotated, inverse state in mind
+                dE -= 2. * sys.eAt(id, j);
+            else
+                dE += 2. * sys.eAt(id, j);
+            ++j;
+        }
+    }
+    else
+    {
+        for (Part *neigh : sys.parts)
+        {
+            if (partA != neigh)
+            {
+                if (neigh->state == partA->state)
+                    dE -= 2. * sys.eAt(id, j);
+                else
+                    dE += 2. * sys.eAt(id, j);
+                ++j;
+            }
+        }
+    }
+
+    dE += 2 * partA->m.scalar(field);
+    return dE;
+}
+
+// Neumaier compensated sum: the rounding error of every addition is kept in the compensation,
+// so the error of the tracked energy does not grow with the number of flips.
+// Sums of integer couplings are exact anyway while they are below 2^53
+class CompensatedSum
+{
+public:
+    CompensatedSum(double value = 0): sum(value), compensation(0) {}
+
+    CompensatedSum & operator+=(double x)
+    {
+        const double t = this->sum + x;
+        if (fabs(this->sum) >= fabs(x))
+            this->compensation += (this->sum - t) + x;
+        else
+            this->compensation += (x - t) + this->sum;
+        this->sum = t;
+        return *this;
+    }
+
+    operator double() const { return this->sum + this->compensation; }
+
+private:
+    double sum;
+    double compensation;
+};
+
+// set the spins of the system to the state of a replica
+inline void loadState(PartArray & sys, const std::vector<bool> & state)
+{
+    for (unsigned i = 0; i < state.size(); ++i){
+        if (sys.parts[i]->state != state[i])
+            sys.parts[i]->rotate(false);
+    }
+}
+
+inline void storeState(const PartArray & sys, std::vector<bool> & state)
+{
+    for (unsigned i = 0; i < state.size(); ++i)
+        state[i] = sys.parts[i]->state;
+}
 
 #endif
\ No newline at end of file
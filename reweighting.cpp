@@ -0,0 +1,182 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include "EnergyHistogram.h"
+#include <argumentum/argparse.h>
+
+using namespace std;
+using namespace argumentum;
+
+// logarithm of the sum of exponents of the values
+static double logSumExp(const std::vector<double> & x)
+{
+    double maxX = -INFINITY;
+    for (double v : x) maxX = std::max(maxX, v);
+    if (std::isinf(maxX)) return maxX;
+    double sum = 0;
+    for (double v : x) sum += exp(v - maxX);
+    return maxX + log(sum);
+}
+
+int main(int argc, char* argv[])
+{
+    auto parser = argumentum::argument_parser{};
+    auto params = parser.params();
+
+    std::vector<std::string> filenames;
+    double tMin, tMax, tolerance;
+    int points, iterations;
+
+    parser.config().program("reweighting")
+        .description("Combines energy histograms of metropolis (energyHistogram option) \
+        from several temperatures by Ferrenberg-Swendsen multiple histogram method (WHAM), \
+        and prints C(T), energy and parameter averages on the dense temperature grid");
+    params.add_parameter(filenames,"files").minargs(1).metavar("FILE.txt")
+        .help("Histogram files, one per temperature. All of them should be of the same system and bin width.");
+    params.add_parameter(tMin,"","--tmin").nargs(1).absent(NAN).metavar("T")
+        .help("Lowest temperature of the grid. Default is the lowest temperature of histograms.");
+    params.add_parameter(tMax,"","--tmax").nargs(1).absent(NAN).metavar("T")
+        .help("Highest temperature of the grid. Default is the highest temperature of histograms.");
+    params.add_parameter(points,"-n","--points").nargs(1).absent(1000).metavar("N")
+        .help("Number of temperatures in the grid. Default is 1000.");
+    params.add_parameter(tolerance,"","--tolerance").nargs(1).absent(1e-10).metavar("TOL")
+        .help("Stop the iterations when free energies change less than TOL. Default is 1e-10.");
+    params.add_parameter(iterations,"","--iterations").nargs(1).absent(100000).metavar("N")
+        .help("Maximal number of iterations. Default is 100000.");
+
+    auto res = parser.parse_args( argc, argv, 1 );
+
+    if ( !res )
+      return 1;
+
+    std::vector<EnergyHistogram> histograms(filenames.size());
+    for (unsigned k = 0; k < filenames.size(); ++k){
+        histograms[k].load(filenames[k]);
+        if (histograms[k].N() != histograms[0].N() ||
+            histograms[k].width() != histograms[0].width() ||
+            histograms[k].parameterIds() != histograms[0].parameterIds()){
+            cerr<<"error! histogram "<<filenames[k]<<" differs from "<<filenames[0]<<" by system, bin width or parameters"<<endl;
+            return 1;
+        }
+        if (histograms[k].temperature() <= 0){
+            cerr<<"error! histogram "<<filenames[k]<<" has non-positive temperature"<<endl;
+            return 1;
+        }
+    }
+    if (points < 2){
+        cerr<<"error! --points should be at least 2"<<endl;
+        return 1;
+    }
+
+    const unsigned R = histograms.size();
+    const unsigned N = histograms[0].N();
+    const std::vector<std::string> & ids = histograms[0].parameterIds();
+    const unsigned P = ids.size();
+
+    // merge the bins of all histograms
+    std::map<long, EnergyHistogram::bin> merged;
+    for (auto & h : histograms){
+        for (auto & it : h.bins()){
+            EnergyHistogram::bin & b = merged[it.first];
+            if (b.count == 0){
+                b.sum.assign(P, 0); b.sumAbs.assign(P, 0); b.sum2.assign(P, 0);
+            }
+            b.count += it.second.count;
+            b.sumE += it.second.sumE;
+            for (unsigned i = 0; i < P; ++i){
+                b.sum[i] += it.second.sum[i];
+                b.sumAbs[i] += it.second.sumAbs[i];
+                b.sum2[i] += it.second.sum2[i];
+            }
+        }
+    }
+    const unsigned B = merged.size();
+    std::vector<double> energies, lnH;
+    std::vector<const EnergyHistogram::bin*> bins;
+    for (auto & it : merged){
+        energies.push_back(it.second.sumE / it.second.count);
+        lnH.push_back(log(it.second.count));
+        bins.push_back(&it.second);
+    }
+
+    std::vector<double> betas(R), lnSamples(R);
+    for (unsigned k = 0; k < R; ++k){
+        betas[k] = 1. / histograms[k].temperature();
+        lnSamples[k] = log(histograms[k].samples());
+    }
+
+    // self-consistent free energies f_k = -ln Z_k of the simulated temperatures
+    std::vector<double> f(R, 0), lng(B), terms(std::max(R, B));
+    int iteration = 0;
+    double change = INFINITY;
+    for (; iteration < iterations && change > tolerance; ++iteration){
+        for (unsigned b = 0; b < B; ++b){
+            terms.resize(R);
+            for (unsigned k = 0; k < R; ++k)
+                terms[k] = lnSamples[k] + f[k] - betas[k] * energies[b];
+            lng[b] = lnH[b] - logSumExp(terms);
+        }
+        change = 0;
+        std::vector<double> fNew(R);
+        for (unsigned k = 0; k < R; ++k){
+            terms.resize(B);
+            for (unsigned b = 0; b < B; ++b)
+                terms[b] = lng[b] - betas[k] * energies[b];
+            fNew[k] = -logSumExp(terms);
+        }
+        for (unsigned k = 0; k < R; ++k){
+            fNew[k] -= fNew[0];
+            change = std::max(change, fabs(fNew[k] - f[k]));
+        }
+        f.swap(fNew);
+    }
+
+    if (std::isnan(tMin)) tMin = 1. / *std::max_element(betas.begin(), betas.end());
+    if (std::isnan(tMax)) tMax = 1. / *std::min_element(betas.begin(), betas.end());
+
+    printf("# multiple histogram reweighting of %u histograms, %u energy bins, %d iterations, last change %g\n",
+        R, B, iteration, change);
+    printf("# legend (column names):\n");
+    printf("# 1:T 2:C(T)/N 3:<E> 4:<E^2>");
+    unsigned col = 5;
+    for (auto & id : ids){
+        printf(" %u:<%s> %u:<|%s|> %u:<%s^2>", col, id.c_str(), col + 1, id.c_str(), col + 2, id.c_str());
+        col += 3;
+    }
+    printf("\n");
+
+    std::vector<double> w(B), p(P), pAbs(P), p2(P);
+    for (int n = 0; n < points; ++n){
+        const double t = tMin + (tMax - tMin) * n / (points - 1);
+        for (unsigned b = 0; b < B; ++b)
+            w[b] = lng[b] - energies[b] / t;
+        const double lnZ = logSumExp(w);
+
+        double e = 0, e2 = 0;
+        std::fill(p.begin(), p.end(), 0);
+        std::fill(pAbs.begin(), pAbs.end(), 0);
+        std::fill(p2.begin(), p2.end(), 0);
+        for (unsigned b = 0; b < B; ++b){
+            const double prob = exp(w[b] - lnZ);
+            e += prob * energies[b];
+            e2 += prob * energies[b] * energies[b];
+            // microcanonical averages of the parameters in the bin
+            for (unsigned i = 0; i < P; ++i){
+                p[i] += prob * bins[b]->sum[i] / bins[b]->count;
+                pAbs[i] += prob * bins[b]->sumAbs[i] / bins[b]->count;
+                p2[i] += prob * bins[b]->sum2[i] / bins[b]->count;
+            }
+        }
+
+        printf("%e %.15e %.15e %.15e", t, (e2 - e * e) / (t * t * N), e, e2);
+        for (unsigned i = 0; i < P; ++i)
+            printf(" %.15e %.15e %.15e", p[i], pAbs[i], p2[i]);
+        printf("\n");
+    }
+
+    return 0;
+}